@@ -18,7 +18,15 @@ HEADERS += structure.h \
     element.h \
     station.h \
     layer.h \
-    layers.h
+    layers.h \
+    catalog.h \
+    libraryscanner.h \
+    structurecache.h \
+    hierarchy.h \
+    geometrycache.h \
+    elementstore.h \
+    spatialindex.h \
+    regionquery.h
 SOURCES += structure.cpp \
     qzip.cpp \
     library.cpp \
@@ -26,6 +34,14 @@ SOURCES += structure.cpp \
     element.cpp \
     station.cpp \
     layer.cpp \
-    layers.cpp
+    layers.cpp \
+    catalog.cpp \
+    libraryscanner.cpp \
+    structurecache.cpp \
+    hierarchy.cpp \
+    geometrycache.cpp \
+    elementstore.cpp \
+    spatialindex.cpp \
+    regionquery.cpp
 #LIBS += -L./opt/local/lib/
 LIBS += -lz
@@ -0,0 +1,179 @@
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QSet>
+#include <QtCore/QSettings>
+#include <QtCore/QTemporaryFile>
+
+#include "qzipreader_p.h"
+
+#include "catalog.h"
+#include "config.h"
+
+namespace Gds {
+
+const QString LIBRARY_META_FILENAME = "LIB.ini";
+const int CATALOG_VERSION = 2;
+
+CatalogEntry::CatalogEntry()
+{
+  valid = false;
+  dbu = 1000;
+  unit = "MM";
+}
+
+
+Catalog::Catalog()
+{
+  _settings = new QSettings(Config::pathToCatalog(), QSettings::IniFormat);
+  if (_settings->value("version", 0).toInt() != CATALOG_VERSION) {
+    _settings->clear();
+    _settings->setValue("version", CATALOG_VERSION);
+  }
+}
+
+
+Catalog::~Catalog()
+{
+  delete _settings;
+}
+
+
+QString Catalog::groupFor(const QFileInfo &info)
+{
+  QByteArray path = info.absoluteFilePath().toUtf8();
+  return QString(
+    QCryptographicHash::hash(path, QCryptographicHash::Md5).toHex());
+}
+
+
+bool Catalog::lookup(const QFileInfo &info, CatalogEntry &entry)
+{
+  _settings->beginGroup(groupFor(info));
+  bool hit =
+      _settings->value("path").toString() == info.absoluteFilePath()
+      && _settings->value("size", -1).toLongLong() == info.size()
+      && _settings->value("mtime", -1).toLongLong()
+         == info.lastModified().toMSecsSinceEpoch();
+  if (hit) {
+    entry.valid = _settings->value("valid", false).toBool();
+    entry.dbu = _settings->value("dbu", 1000).toInt();
+    entry.unit = _settings->value("unit", "MM").toString();
+    entry.structureNames = _settings->value("structures").toStringList();
+  }
+  _settings->endGroup();
+  return hit;
+}
+
+
+void Catalog::store(const QFileInfo &info, const CatalogEntry &entry)
+{
+  _settings->beginGroup(groupFor(info));
+  _settings->setValue("path", info.absoluteFilePath());
+  _settings->setValue("size", info.size());
+  _settings->setValue("mtime", info.lastModified().toMSecsSinceEpoch());
+  _settings->setValue("valid", entry.valid);
+  _settings->setValue("dbu", entry.dbu);
+  _settings->setValue("unit", entry.unit);
+  _settings->setValue("structures", entry.structureNames);
+  _settings->endGroup();
+}
+
+
+CatalogEntry Catalog::entryFor(const QFileInfo &info)
+{
+  CatalogEntry entry;
+  if (lookup(info, entry)) {
+    return entry;
+  }
+  entry = scan(info);
+  store(info, entry);
+  return entry;
+}
+
+
+// Drops the entries of archives that no longer exist.
+void Catalog::prune()
+{
+  foreach (QString group, _settings->childGroups()) {
+    QString path = _settings->value(group + "/path").toString();
+    if (! QFileInfo(path).exists()) {
+      _settings->remove(group);
+    }
+  }
+}
+
+
+void Catalog::sync()
+{
+  _settings->sync();
+}
+
+
+// Reads only the central directory and LIB.ini of the archive.
+CatalogEntry Catalog::scan(const QFileInfo &info)
+{
+  CatalogEntry entry;
+  QZipReader reader(info.absoluteFilePath(), QIODevice::ReadOnly);
+  if (reader.status() != QZipReader::NoError) {
+    qDebug() << "open error: " << info.absolutePath();
+    return entry;
+  }
+
+  QList<QZipReader::FileInfo> list = reader.fileInfoList();
+  QSet<QString> names;
+  foreach (QZipReader::FileInfo member, list) {
+    if (member.filePath == LIBRARY_META_FILENAME) {
+      entry.valid = true;
+    }
+    QString dirName = member.filePath.section('/', 0, 0);
+    QFileInfo dirInfo(dirName);
+    if (dirInfo.completeSuffix() != "structure") continue;
+    QString name = dirInfo.completeBaseName().toUpper();
+    if (! names.contains(name)) {
+      names.insert(name);
+      entry.structureNames.push_back(name);
+    }
+  }
+  entry.structureNames.sort();
+  if (entry.valid) {
+    readMeta(reader.fileData(LIBRARY_META_FILENAME), entry);
+  }
+  reader.close();
+  return entry;
+}
+
+
+void Catalog::readMeta(const QString &pathToMeta, CatalogEntry &entry)
+{
+  QSettings meta(pathToMeta, QSettings::IniFormat);
+  meta.beginGroup("INITLIB");
+  entry.dbu = meta.value("dbu", 1000).toInt();
+  entry.unit = meta.value("unit", "MM").toString();
+  entry.name = meta.value("name", "").toString();
+  meta.endGroup();
+}
+
+
+void Catalog::readMeta(const QByteArray &contents, CatalogEntry &entry)
+{
+  QTemporaryFile spool;
+  if (! spoolMeta(contents, spool)) return;
+  readMeta(spool.fileName(), entry);
+}
+
+
+// QSettings only reads from a path, so spool the single ini member.
+bool Catalog::spoolMeta(const QByteArray &contents, QTemporaryFile &spool)
+{
+  if (contents.isEmpty()) return false;
+  if (! spool.open()) {
+    qDebug() << "can't spool: " << LIBRARY_META_FILENAME;
+    return false;
+  }
+  spool.write(contents);
+  spool.flush();
+  return true;
+}
+
+} // namespace Gds
@@ -0,0 +1,54 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <QtCore/QFileInfo>
+#include <QtCore/QStringList>
+
+class QSettings;
+class QTemporaryFile;
+
+namespace Gds {
+
+extern const QString LIBRARY_META_FILENAME;
+
+struct CatalogEntry
+{
+  CatalogEntry();
+
+  bool valid;
+  int dbu;
+  QString unit;
+  QString name;
+  QStringList structureNames;
+};
+
+
+// Remembers what was found in each *.DB archive, keyed by path, size and
+// modification time, so only archives that changed are opened again.
+// A closed library answers its unit and structure names from here.
+class Catalog
+{
+public:
+  Catalog();
+  ~Catalog();
+
+  bool lookup(const QFileInfo &info, CatalogEntry &entry);
+  void store(const QFileInfo &info, const CatalogEntry &entry);
+  CatalogEntry entryFor(const QFileInfo &info);
+  void prune();
+  void sync();
+
+  static CatalogEntry scan(const QFileInfo &info);
+  static void readMeta(const QString &pathToMeta, CatalogEntry &entry);
+  static void readMeta(const QByteArray &contents, CatalogEntry &entry);
+  static bool spoolMeta(const QByteArray &contents, QTemporaryFile &spool);
+
+private:
+  static QString groupFor(const QFileInfo &info);
+
+  QSettings *_settings;
+};
+
+} // namespace Gds
+
+#endif // CATALOG_H
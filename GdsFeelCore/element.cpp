@@ -1,529 +1,927 @@
-#include "element.h"
-#include "structure.h"
-#include "library.h"
-
-namespace Gds {
-
-Element::Element()
-{
-  _vertices.clear();
-  _dataBounds = 0;
-  _outlinePoints = 0;
-}
-
-
-Element::~Element()
-{
-  _vertices.clear();
-  clearGeometryCache();
-}
-
-
-Structure *Element::structure()
-{
-  return qobject_cast<Structure *>(parent());
-}
-
-
-Library *Element::library()
-{
-  if (structure() == nullptr) {
-    return 0;
-  }
-  return structure()->library();
-}
-
-
-void Element::clearGeometryCache()
-{
-  free(_dataBounds);
-  _dataBounds = 0;
-  if (_outlinePoints) {
-    _outlinePoints->clear();
-  }
-  free(_outlinePoints);
-  _outlinePoints = 0;
-}
-
-
-void Element::setVertices(const QList<QPointF> &vertices)
-{
-  _vertices.clear();
-  _vertices.append(vertices);
-  clearGeometryCache();
-}
-
-
-void Element::setAttributes(QDomElement e)
-{
-  QList<QPointF> points;
-  QDomElement verte = e.firstChildElement("vertices");
-  QDomNode xyn = verte.firstChildElement("xy");
-  while (!xyn.isNull()) {
-    QDomElement xye = xyn.toElement();
-//    qDebug() << qPrintable(xye.tagName()) << endl;
-//    qDebug() << xye.text();
-    QStringList items = xye.text().split(" ");
-    QPointF pt(items[0].toFloat(), items.at(1).toFloat());
-    points.push_back(pt);
-    xyn = xyn.nextSibling();
-  }
-  setVertices(points);
-  _keyNumber = e.attribute("keyNumber").toInt();
-}
-
-
-QList<QPointF> Element::outlinePoints()
-{
-  QList<QPointF> result;
-  if (_outlinePoints == nullptr) {
-    _outlinePoints = new QList<QPointF>;
-    lookupOutlinePoints(*_outlinePoints);
-  }
-  return *_outlinePoints;
-}
-
-
-const qreal MAX_VAL = 32767;
-
-
-QRectF Element::dataBounds()
-{
-  if (_dataBounds == nullptr) {
-    _dataBounds = new QRectF;
-    resetToSmallBounds(*_dataBounds);
-    lookupDataBounds(*_dataBounds);
-  }
-  return *_dataBounds;
-}
-
-
-void Element::resetToSmallBounds(QRectF &bounds)
-{
-  bounds.setCoords(MAX_VAL, MAX_VAL, -MAX_VAL, -MAX_VAL);
-}
-
-
-void Element::calcDataBounds(QList<QPointF> points, QRectF &bounds)
-{
-  qreal xmin = MAX_VAL;
-  qreal xmax = -MAX_VAL;
-  qreal ymin = MAX_VAL;
-  qreal ymax = -MAX_VAL;
-  foreach (QPointF p, points) {
-    if (p.x() < xmin) xmin = p.x();
-    if (p.x() > xmax) xmax = p.x();
-    if (p.y() < ymin) ymin = p.y();
-    if (p.y() > ymax) ymax = p.y();
-  }
-  bounds.setCoords(xmin, ymin, xmax, ymax);
-}
-
-
-void Element::calcOutlinePoints(QRectF bounds, QList<QPointF> &points)
-{
-  qreal xmin, xmax, ymin, ymax;
-  bounds.getCoords(&xmin, &ymin, &xmax, &ymax);
-  points.append(QPointF(xmin, ymin));
-  points.append(QPointF(xmin, ymax));
-  points.append(QPointF(xmax, ymax));
-  points.append(QPointF(xmax, ymin));
-  points.append(QPointF(xmin, ymin));
-}
-
-
-void Element::lookupDataBounds(QRectF &bounds)
-{
-  calcDataBounds(outlinePoints(), bounds);
-}
-
-
-void Element::lookupOutlinePoints(QList<QPointF> &points)
-{
-  points = vertices();
-}
-
-
-static Element* newElementFromType(QString type)
-{
-  if (type == QString("boundary")) {
-    return new Boundary();
-  }
-  if (type == QString("path")) {
-    return new Path();
-  }
-  if (type == QString("sref")) {
-    return new Sref();
-  }
-  if (type == QString("aref")) {
-    return new Aref();
-  }
-  qDebug() << "Can't handled: " << type << endl;
-  return 0;
-}
-
-
-Element*
-Element::fromXmlElement(QDomElement e)
-{
-  Element *elm = newElementFromType(e.attribute("type"));
-  if (elm == nullptr) return 0;
-  elm->setAttributes(e);
-  return elm;
-}
-
-
-PrimitiveElement::PrimitiveElement()
-{
-  _datatype = 0;
-  _layerNumber = 0;
-}
-
-
-void PrimitiveElement::setAttributes(QDomElement e)
-{
-  Element::setAttributes(e);
-  _datatype = e.attribute("datatype", "0").toInt();
-  _layerNumber = e.attribute("layerNumber", "0").toInt();
-}
-
-
-Path::Path()
-{
-  _width = 0.0;
-  _pathtype = 0;
-}
-
-
-static qreal
-getAngle(qreal x1, qreal y1, qreal x2, qreal y2)
-{
-  qreal angle;
-
-  if(x1 == x2)
-    angle =  M_PI_2 * ((y2 > y1) ? 1 : -1);
-  else
-  {
-    angle = atan(fabs(y2 - y1)/fabs(x2 - x1));
-    if(y2 >= y1)
-    {
-      if(x2 >= x1)
-        angle += 0;
-      else
-        angle = M_PI - angle;
-    }
-    else
-    {
-      if(x2 >= x1)
-        angle = 2 * M_PI - angle;
-      else
-        angle += M_PI;
-    }
-  }
-
-  return angle;
-}
-
-#define EPS 1e-8
-
-static QPointF
-getDeltaXY(qreal hw, QPointF p1, QPointF p2, QPointF p3)
-{
-  qreal alpha, beta, theta, r;
-  QPointF pnt;
-
-  alpha = getAngle(p1.x(), p1.y(), p2.x(), p2.y());
-  beta = getAngle(p2.x(), p2.y(), p3.x(), p3.y());
-
-  theta = (alpha + beta + M_PI)/2.0;
-
-  if(fabs(cos((alpha - beta)/2.0)) < EPS)
-  {
-    qDebug() << "Internal algorithm error: cos((alpha - beta)/2) = 0" << endl;
-    return pnt;
-  }
-  r = ((double) hw) / cos((alpha - beta)/2.0);
-
-  pnt.setX((qreal) (r * cos(theta)));
-  pnt.setY((qreal) (r * sin(theta)));
-
-  return pnt;
-}
-
-static QPointF
-getEndDeltaXY(qreal hw, QPointF p1, QPointF p2)
-{
-  qreal alpha, theta, r;
-  QPointF pnt;
-
-  alpha = getAngle(p1.x(), p1.y(), p2.x(), p2.y());
-
-  theta = alpha;
-  r= hw;
-  pnt.setX(-r * sin(theta));
-  pnt.setY(r * cos(theta));
-
-  return pnt;
-}
-
-
-static void
-pathOutlinePoints(Path* path, QList<QPointF> &outpoints)
-{
-  outpoints.clear();
-  if (path ->width() == 0.0) {
-    outpoints.append(path->vertices());
-    return;
-  }
-
-  qreal hw = path->halhWidth();
-  int numpoints = path->vertices().size();
-  if (numpoints < 2) {
-    qDebug() << "PathToBoundary(): don't know to handle wires < 2 pts yet" << endl;
-    return;
-  }
-  QPointF deltaxy =
-      getEndDeltaXY(hw, path->vertices()[0], path->vertices()[1]);
-  QVector<QPointF> points(2 * numpoints + 1);
-  if (path->pathtype() == 0) {
-    points[0].setX(path->vertices()[0].x() + deltaxy.x());
-    points[0].setY(path->vertices()[0].y() + deltaxy.y());
-    points[2 * numpoints].setX(points[0].x());
-    points[2 * numpoints].setY(points[0].y());
-    points[2 * numpoints - 1].setX(path->vertices()[0].x() - deltaxy.x());
-    points[2 * numpoints - 1].setY(path->vertices()[0].y() - deltaxy.y());
-  }
-  else {
-    points[0].setX(path->vertices()[0].x() + deltaxy.x() - deltaxy.y());
-    points[0].setY(path->vertices()[0].y() + deltaxy.y() - deltaxy.x());
-    points[2 * numpoints].setX(points[0].x());
-    points[2 * numpoints].setY(points[0].y());
-    points[2 * numpoints - 1].setX(path->vertices()[0].x() - deltaxy.x() - deltaxy.y());
-    points[2 * numpoints - 1].setY(path->vertices()[0].y() - deltaxy.y() - deltaxy.x());
-  }
-
-  for(int i = 1; i < numpoints - 1; i++)
-  {
-    deltaxy = getDeltaXY(hw, path->vertices()[i - 1],
-                         path->vertices()[i], path->vertices()[i + 1]);
-    points[i].setX(path->vertices()[i].x() + deltaxy.x());
-    points[i].setY(path->vertices()[i].y() + deltaxy.y());
-    points[2 * numpoints - i - 1].setX(path->vertices()[i].x() - deltaxy.x());
-    points[2 * numpoints - i - 1].setY(path->vertices()[i].y() - deltaxy.y());
-  }
-
-  deltaxy = getEndDeltaXY(hw, path->vertices()[numpoints - 2],
-                          path->vertices()[numpoints - 1]);
-  if(path->pathtype() == 0)
-  {
-    points[numpoints - 1].setX(path->vertices()[numpoints - 1].x() + deltaxy.x());
-    points[numpoints - 1].setY(path->vertices()[numpoints - 1].y() + deltaxy.y());
-    points[numpoints].setX(path->vertices()[numpoints - 1].x() - deltaxy.x());
-    points[numpoints].setY(path->vertices()[numpoints - 1].y() - deltaxy.y());
-  }
-  else /* Extended end */
-  {
-    points[numpoints - 1].setX(path->vertices()[numpoints - 1].x() + deltaxy.x() + deltaxy.y());
-    points[numpoints - 1].setY(path->vertices()[numpoints - 1].y() + deltaxy.y() + deltaxy.x());
-    points[numpoints].setX(path->vertices()[numpoints - 1].x() - deltaxy.x() + deltaxy.y());
-    points[numpoints].setY(path->vertices()[numpoints - 1].y() - deltaxy.y() + deltaxy.x());
-  }
-  outpoints.append(points.toList());
-}
-
-
-void Path::lookupOutlinePoints(QList<QPointF> &points)
-{
-  pathOutlinePoints(this, points);
-}
-
-
-void Path::setAttributes(QDomElement e)
-{
-  PrimitiveElement::setAttributes(e);
-  _pathtype = e.attribute("pathtype", "0").toInt();
-  _width = e.attribute("width", "0.0").toFloat();
-}
-
-
-ReferenceElement::ReferenceElement()
-{
-  _mag = 1.0;
-  _angle = 0.0;
-  _reflected = false;
-  _mat = 0;
-}
-
-
-ReferenceElement::~ReferenceElement()
-{
-  free(_mat);
-  _mat = 0;
-}
-
-
-void ReferenceElement::clearGeometryCache()
-{
-  Element::clearGeometryCache();
-  free(_mat);
-  _mat = 0;
-}
-
-
-QPointF ReferenceElement::origin() const
-{
-  Q_ASSERT(! vertices().isEmpty());
-  return vertices().first();
-}
-
-
-void ReferenceElement::setAttributes(QDomElement e)
-{
-  Element::setAttributes(e);
-  _mag = e.attribute("mag", "1.0").toDouble();
-  _angle = e.attribute("angle", "0.0").toDouble();
-  _reflected = e.attribute("reflected", "false") == QString("true");
-  if (_reflected) {
-    qDebug() << "MIRROR" << endl;
-  }
-  clearGeometryCache();
-}
-
-
-QMatrix ReferenceElement::transform()
-{
-  if (_mat == nullptr) {
-    _mat = new QMatrix;
-    getTransform(*_mat);
-  }
-  return *_mat;
-}
-
-
-void ReferenceElement::getTransform(QMatrix &mat)
-{
-  qreal rad = _angle * M_PI / 180.0;
-  qreal cos_rad = cos(rad);
-  qreal sin_rad = sin(rad);
-
-  qreal a =  _mag * cos_rad;
-  qreal b = -_mag * sin_rad;
-  qreal c = origin().x();
-  qreal d =  _mag * sin_rad;
-  qreal e =  _mag * cos_rad;
-  qreal f = origin().y();
-
-  /* GDSII understands only the Y mirroring */
-  /* Reflecting about X means changing *Y* */
-  if (_reflected) {
-    b = -b;
-    e = -e;
-  }
-  mat.setMatrix(a, d, b, e, c, f);
-}
-
-
-void Sref::lookupOutlinePoints(QList<QPointF> &points)
-{
-  lookupOutlinePoints(transform(), points);
-}
-
-
-void Sref::lookupOutlinePoints(QMatrix mat, QList<QPointF> &points)
-{
-  if (referenceName().isEmpty()) {
-    qDebug() << "empty reference name" << endl;
-    return;
-  }
-  if (library() == nullptr) {
-    qDebug() << "library not bind" << endl;
-    return;
-  }
-  Structure *ref = library()->structureNamed(referenceName());
-  if (ref == nullptr) {
-    qDebug() << "structure not found: " << referenceName() << endl;
-    return;
-  }
-
-  QList<QPointF> outlinePoints;
-  Element::calcOutlinePoints(ref->dataBounds(), outlinePoints);
-
-  foreach (QPointF p, outlinePoints) {
-    points.append(mat.map(p));
-  }
-}
-
-
-void Sref::setAttributes(QDomElement e)
-{
-  ReferenceElement::setAttributes(e);
-  _referenceName = e.attribute("sname", "").toUpper();
-}
-
-
-Aref::Aref()
-{
-  _transforms = 0;
-}
-
-
-Aref::~Aref()
-{
-  if (_transforms) {
-    _transforms->clear();
-  }
-  free(_transforms);
-  _transforms = 0;
-}
-
-
-void Aref::clearGeometryCache()
-{
-  Sref::clearGeometryCache();
-  free(_transforms);
-  _transforms = 0;
-}
-
-
-void Aref::setAttributes(QDomElement e)
-{
-  Sref::setAttributes(e);
-  QDomElement ashapeDE = e.firstChildElement("ashape");
-  if (ashapeDE.isNull()) {
-    qDebug() << "ashape element not found" << endl;
-    return;
-  }
-  QDomElement ae = ashapeDE.toElement();
-  _rowCount = ae.attribute("rows", "1").toInt();
-  _columnCount = ae.attribute("cols", "1").toInt();
-  _rowStep = ae.attribute("row-spacing", "0.0").toDouble();
-  _columnStep = ae.attribute("column-spacing", "0.0").toDouble();
-  clearGeometryCache();
-}
-
-
-QList<QMatrix> Aref::transforms()
-{
-  if (_transforms == nullptr) {
-    _transforms = new QList<QMatrix>;
-    lookupTransforms(*_transforms);
-  }
-  return *_transforms;
-}
-
-
-void Aref::lookupTransforms(QList<QMatrix> &transforms)
-{
-  for (int ri = 0; ri < _rowCount; ri++) {
-    for (int ci = 0; ci < _columnCount; ci++) {
-      double xOffset = ci * _columnStep;
-      double yOffset = ri * _rowStep;
-      QMatrix copy(transform());
-      copy.translate(xOffset, yOffset);
-      transforms.append(copy);
-    }
-  }
-}
-
-
-} // namespace Gds
+#include <QtCore/QVector>
+
+#include "element.h"
+#include "structure.h"
+#include "library.h"
+
+namespace Gds {
+
+Element::Element()
+{
+  _vertices.clear();
+  _dataBounds = 0;
+  _outlinePoints = 0;
+}
+
+
+Element::~Element()
+{
+  _vertices.clear();
+  clearGeometryCache();
+}
+
+
+Structure *Element::structure()
+{
+  return qobject_cast<Structure *>(parent());
+}
+
+
+Library *Element::library()
+{
+  if (structure() == nullptr) {
+    return 0;
+  }
+  return structure()->library();
+}
+
+
+void Element::clearGeometryCache()
+{
+  delete _dataBounds;
+  _dataBounds = 0;
+  delete _outlinePoints;
+  _outlinePoints = 0;
+}
+
+
+void Element::setVertices(const QList<QPointF> &vertices)
+{
+  _vertices.clear();
+  _vertices.append(vertices);
+  clearGeometryCache();
+}
+
+
+static QString attributeValue(const QXmlStreamAttributes &attrs,
+                              const QString &name,
+                              const QString &defaultValue = QString())
+{
+  if (! attrs.hasAttribute(name)) {
+    return defaultValue;
+  }
+  return attrs.value(name).toString();
+}
+
+
+void Element::setAttributes(const QXmlStreamAttributes &attrs)
+{
+  _keyNumber = attributeValue(attrs, "keyNumber").toInt();
+}
+
+
+void Element::storeRecord(ElementRecord &record, QString &name) const
+{
+  Q_UNUSED(name);
+  record.kind = kind();
+  record.keyNumber = _keyNumber;
+  record.vertexCount = _vertices.size();
+}
+
+
+void Element::restoreRecord(const ElementRecord &record, const QString &name)
+{
+  Q_UNUSED(name);
+  _keyNumber = record.keyNumber;
+}
+
+
+static QString typeNameOf(int kind)
+{
+  switch (kind) {
+  case Element::BoundaryKind:
+    return "boundary";
+  case Element::PathKind:
+    return "path";
+  case Element::SrefKind:
+    return "sref";
+  case Element::ArefKind:
+    return "aref";
+  }
+  return QString();
+}
+
+
+// 15 significant digits read back exactly through scanCoordinate().
+static QString numberText(double value)
+{
+  return QString::number(value, 'g', 15);
+}
+
+
+void Element::writeAttributes(QXmlStreamWriter &writer) const
+{
+  writer.writeAttribute("type", typeNameOf(kind()));
+  writer.writeAttribute("keyNumber", QString::number(_keyNumber));
+}
+
+
+void Element::writeChildElements(QXmlStreamWriter &writer) const
+{
+  writer.writeStartElement("vertices");
+  foreach (const QPointF &pt, _vertices) {
+    writer.writeTextElement("xy", numberText(pt.x()) + " " + numberText(pt.y()));
+  }
+  writer.writeEndElement();
+}
+
+
+// The inverse of fromXmlStream().
+void Element::toXmlStream(QXmlStreamWriter &writer) const
+{
+  writer.writeStartElement("element");
+  writeAttributes(writer);
+  writeChildElements(writer);
+  writer.writeEndElement();
+}
+
+
+// Called with the reader on a child start element of <element>. Returns
+// false if the child is not handled, and the caller skips it.
+bool Element::readChildElement(QXmlStreamReader &reader)
+{
+  if (reader.name() == QLatin1String("vertices")) {
+    readVertices(reader);
+    return true;
+  }
+  return false;
+}
+
+
+static inline bool isBlank(ushort c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+
+static inline bool isDigit(ushort c)
+{
+  return c >= '0' && c <= '9';
+}
+
+
+static const double kPowersOfTen[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+// Scans one number starting at p. Plain decimals with up to 15
+// significant digits are converted with a single correctly rounded
+// multiply or divide; anything else (exponents, long mantissas) falls
+// back to QString::toDouble(). Returns the position after the number,
+// or 0 if there is none.
+static const QChar *scanCoordinate(const QChar *p, const QChar *end, double &value)
+{
+  const QChar *start = p;
+  bool negative = false;
+  if (p < end && (p->unicode() == '-' || p->unicode() == '+')) {
+    negative = p->unicode() == '-';
+    p++;
+  }
+  quint64 mantissa = 0;
+  int digits = 0;
+  int scale = 0;
+  bool seen = false;
+  for (; p < end && isDigit(p->unicode()); p++) {
+    seen = true;
+    mantissa = mantissa * 10 + (p->unicode() - '0');
+    if (mantissa != 0) digits++;
+  }
+  if (p < end && p->unicode() == '.') {
+    for (p++; p < end && isDigit(p->unicode()); p++) {
+      seen = true;
+      mantissa = mantissa * 10 + (p->unicode() - '0');
+      if (mantissa != 0) digits++;
+      scale++;
+    }
+  }
+  if (! seen) {
+    return 0;
+  }
+  if (digits > 15 || scale > 22 || (p < end && ! isBlank(p->unicode()))) {
+    while (p < end && ! isBlank(p->unicode())) p++;
+    bool ok = false;
+    value = QString::fromRawData(start, p - start).toDouble(&ok);
+    return ok ? p : 0;
+  }
+  value = double(mantissa) / kPowersOfTen[scale];
+  if (negative) value = -value;
+  return p;
+}
+
+
+// Appends every blank-separated number in [p, end) to coords.
+static bool parseCoordinates(const QChar *p, const QChar *end, QVector<double> &coords)
+{
+  while (true) {
+    while (p < end && isBlank(p->unicode())) p++;
+    if (p == end) {
+      return true;
+    }
+    double value;
+    p = scanCoordinate(p, end, value);
+    if (p == 0) {
+      return false;
+    }
+    coords.append(value);
+  }
+}
+
+
+void Element::readVertices(QXmlStreamReader &reader)
+{
+  QVector<double> coords;
+  QString text;
+  while (reader.readNextStartElement()) {
+    if (reader.name() != QLatin1String("xy")) {
+      reader.skipCurrentElement();
+      continue;
+    }
+    text.resize(0);
+    while (! reader.atEnd()) {
+      QXmlStreamReader::TokenType token = reader.readNext();
+      if (token == QXmlStreamReader::Characters) {
+        text.append(reader.text());
+      }
+      else if (token == QXmlStreamReader::StartElement) {
+        reader.skipCurrentElement();
+      }
+      else if (token == QXmlStreamReader::EndElement) {
+        break;
+      }
+    }
+    int count = coords.size();
+    if (! parseCoordinates(text.constData(), text.constData() + text.size(), coords)
+        || coords.size() - count != 2) {
+      qDebug() << "bad xy: " << text << endl;
+      coords.resize(count);
+    }
+  }
+  QList<QPointF> points;
+  points.reserve(coords.size() / 2);
+  for (int i = 0; i + 1 < coords.size(); i += 2) {
+    points.append(QPointF(coords.at(i), coords.at(i + 1)));
+  }
+  setVertices(points);
+}
+
+
+QList<QPointF> Element::outlinePoints()
+{
+  QList<QPointF> result;
+  if (_outlinePoints == nullptr) {
+    _outlinePoints = new QList<QPointF>;
+    lookupOutlinePoints(*_outlinePoints);
+  }
+  return *_outlinePoints;
+}
+
+
+const qreal MAX_VAL = 32767;
+
+
+QRectF Element::dataBounds()
+{
+  if (_dataBounds == nullptr) {
+    _dataBounds = new QRectF;
+    resetToSmallBounds(*_dataBounds);
+    lookupDataBounds(*_dataBounds);
+  }
+  return *_dataBounds;
+}
+
+
+void Element::resetToSmallBounds(QRectF &bounds)
+{
+  bounds.setCoords(MAX_VAL, MAX_VAL, -MAX_VAL, -MAX_VAL);
+}
+
+
+void Element::calcDataBounds(QList<QPointF> points, QRectF &bounds)
+{
+  qreal xmin = MAX_VAL;
+  qreal xmax = -MAX_VAL;
+  qreal ymin = MAX_VAL;
+  qreal ymax = -MAX_VAL;
+  foreach (QPointF p, points) {
+    if (p.x() < xmin) xmin = p.x();
+    if (p.x() > xmax) xmax = p.x();
+    if (p.y() < ymin) ymin = p.y();
+    if (p.y() > ymax) ymax = p.y();
+  }
+  bounds.setCoords(xmin, ymin, xmax, ymax);
+}
+
+
+void Element::calcOutlinePoints(QRectF bounds, QList<QPointF> &points)
+{
+  qreal xmin, xmax, ymin, ymax;
+  bounds.getCoords(&xmin, &ymin, &xmax, &ymax);
+  points.append(QPointF(xmin, ymin));
+  points.append(QPointF(xmin, ymax));
+  points.append(QPointF(xmax, ymax));
+  points.append(QPointF(xmax, ymin));
+  points.append(QPointF(xmin, ymin));
+}
+
+
+void Element::lookupDataBounds(QRectF &bounds)
+{
+  calcDataBounds(outlinePoints(), bounds);
+}
+
+
+void Element::lookupOutlinePoints(QList<QPointF> &points)
+{
+  points = vertices();
+}
+
+
+static Element* newElementFromType(QString type)
+{
+  if (type == QString("boundary")) {
+    return new Boundary();
+  }
+  if (type == QString("path")) {
+    return new Path();
+  }
+  if (type == QString("sref")) {
+    return new Sref();
+  }
+  if (type == QString("aref")) {
+    return new Aref();
+  }
+  qDebug() << "Can't handled: " << type << endl;
+  return 0;
+}
+
+
+static Element* newElementFromKind(int kind)
+{
+  switch (kind) {
+  case Element::BoundaryKind:
+    return new Boundary();
+  case Element::PathKind:
+    return new Path();
+  case Element::SrefKind:
+    return new Sref();
+  case Element::ArefKind:
+    return new Aref();
+  }
+  qDebug() << "Can't handled kind: " << kind << endl;
+  return 0;
+}
+
+
+// Rebuilds an element from its cached record. coordinates points to the
+// record's first vertex, as x, y pairs.
+Element*
+Element::fromRecord(const ElementRecord &record, const QString &name,
+                    const double *coordinates)
+{
+  Element *elm = newElementFromKind(record.kind);
+  if (elm == nullptr) {
+    return 0;
+  }
+  elm->restoreRecord(record, name);
+  QList<QPointF> points;
+  points.reserve(record.vertexCount);
+  for (quint32 i = 0; i < record.vertexCount; i++) {
+    points.append(QPointF(coordinates[2 * i], coordinates[2 * i + 1]));
+  }
+  elm->setVertices(points);
+  return elm;
+}
+
+
+// Builds an element from the reader positioned on an <element> start
+// tag, leaving it on the matching end tag.
+Element*
+Element::fromXmlStream(QXmlStreamReader &reader)
+{
+  QXmlStreamAttributes attrs = reader.attributes();
+  Element *elm = newElementFromType(attributeValue(attrs, "type"));
+  if (elm == nullptr) {
+    reader.skipCurrentElement();
+    return 0;
+  }
+  elm->setAttributes(attrs);
+  while (reader.readNextStartElement()) {
+    if (! elm->readChildElement(reader)) {
+      reader.skipCurrentElement();
+    }
+  }
+  return elm;
+}
+
+
+PrimitiveElement::PrimitiveElement()
+{
+  _datatype = 0;
+  _layerNumber = 0;
+}
+
+
+void PrimitiveElement::setAttributes(const QXmlStreamAttributes &attrs)
+{
+  Element::setAttributes(attrs);
+  _datatype = attributeValue(attrs, "datatype", "0").toInt();
+  _layerNumber = attributeValue(attrs, "layerNumber", "0").toInt();
+}
+
+
+void PrimitiveElement::writeAttributes(QXmlStreamWriter &writer) const
+{
+  Element::writeAttributes(writer);
+  writer.writeAttribute("layerNumber", QString::number(_layerNumber));
+  writer.writeAttribute("datatype", QString::number(_datatype));
+}
+
+
+void PrimitiveElement::storeRecord(ElementRecord &record, QString &name) const
+{
+  Element::storeRecord(record, name);
+  record.datatype = _datatype;
+  record.layerNumber = _layerNumber;
+}
+
+
+void PrimitiveElement::restoreRecord(const ElementRecord &record, const QString &name)
+{
+  Element::restoreRecord(record, name);
+  _datatype = record.datatype;
+  _layerNumber = record.layerNumber;
+}
+
+
+Path::Path()
+{
+  _width = 0.0;
+  _pathtype = 0;
+}
+
+
+static qreal
+getAngle(qreal x1, qreal y1, qreal x2, qreal y2)
+{
+  qreal angle;
+
+  if(x1 == x2)
+    angle =  M_PI_2 * ((y2 > y1) ? 1 : -1);
+  else
+  {
+    angle = atan(fabs(y2 - y1)/fabs(x2 - x1));
+    if(y2 >= y1)
+    {
+      if(x2 >= x1)
+        angle += 0;
+      else
+        angle = M_PI - angle;
+    }
+    else
+    {
+      if(x2 >= x1)
+        angle = 2 * M_PI - angle;
+      else
+        angle += M_PI;
+    }
+  }
+
+  return angle;
+}
+
+#define EPS 1e-8
+
+static QPointF
+getDeltaXY(qreal hw, QPointF p1, QPointF p2, QPointF p3)
+{
+  qreal alpha, beta, theta, r;
+  QPointF pnt;
+
+  alpha = getAngle(p1.x(), p1.y(), p2.x(), p2.y());
+  beta = getAngle(p2.x(), p2.y(), p3.x(), p3.y());
+
+  theta = (alpha + beta + M_PI)/2.0;
+
+  if(fabs(cos((alpha - beta)/2.0)) < EPS)
+  {
+    qDebug() << "Internal algorithm error: cos((alpha - beta)/2) = 0" << endl;
+    return pnt;
+  }
+  r = ((double) hw) / cos((alpha - beta)/2.0);
+
+  pnt.setX((qreal) (r * cos(theta)));
+  pnt.setY((qreal) (r * sin(theta)));
+
+  return pnt;
+}
+
+static QPointF
+getEndDeltaXY(qreal hw, QPointF p1, QPointF p2)
+{
+  qreal alpha, theta, r;
+  QPointF pnt;
+
+  alpha = getAngle(p1.x(), p1.y(), p2.x(), p2.y());
+
+  theta = alpha;
+  r= hw;
+  pnt.setX(-r * sin(theta));
+  pnt.setY(r * cos(theta));
+
+  return pnt;
+}
+
+
+// Outline of a path given by its vertices, pathtype and width, so paths
+// can be outlined without a Path object.
+void
+Path::outlineOf(const QList<QPointF> &vertices, int pathtype, double width,
+                QList<QPointF> &outpoints)
+{
+  outpoints.clear();
+  if (width == 0.0) {
+    outpoints.append(vertices);
+    return;
+  }
+
+  qreal hw = width / 2.0;
+  int numpoints = vertices.size();
+  if (numpoints < 2) {
+    qDebug() << "PathToBoundary(): don't know to handle wires < 2 pts yet" << endl;
+    return;
+  }
+  QPointF deltaxy =
+      getEndDeltaXY(hw, vertices[0], vertices[1]);
+  QVector<QPointF> points(2 * numpoints + 1);
+  if (pathtype == 0) {
+    points[0].setX(vertices[0].x() + deltaxy.x());
+    points[0].setY(vertices[0].y() + deltaxy.y());
+    points[2 * numpoints].setX(points[0].x());
+    points[2 * numpoints].setY(points[0].y());
+    points[2 * numpoints - 1].setX(vertices[0].x() - deltaxy.x());
+    points[2 * numpoints - 1].setY(vertices[0].y() - deltaxy.y());
+  }
+  else {
+    points[0].setX(vertices[0].x() + deltaxy.x() - deltaxy.y());
+    points[0].setY(vertices[0].y() + deltaxy.y() - deltaxy.x());
+    points[2 * numpoints].setX(points[0].x());
+    points[2 * numpoints].setY(points[0].y());
+    points[2 * numpoints - 1].setX(vertices[0].x() - deltaxy.x() - deltaxy.y());
+    points[2 * numpoints - 1].setY(vertices[0].y() - deltaxy.y() - deltaxy.x());
+  }
+
+  for(int i = 1; i < numpoints - 1; i++)
+  {
+    deltaxy = getDeltaXY(hw, vertices[i - 1],
+                         vertices[i], vertices[i + 1]);
+    points[i].setX(vertices[i].x() + deltaxy.x());
+    points[i].setY(vertices[i].y() + deltaxy.y());
+    points[2 * numpoints - i - 1].setX(vertices[i].x() - deltaxy.x());
+    points[2 * numpoints - i - 1].setY(vertices[i].y() - deltaxy.y());
+  }
+
+  deltaxy = getEndDeltaXY(hw, vertices[numpoints - 2],
+                          vertices[numpoints - 1]);
+  if(pathtype == 0)
+  {
+    points[numpoints - 1].setX(vertices[numpoints - 1].x() + deltaxy.x());
+    points[numpoints - 1].setY(vertices[numpoints - 1].y() + deltaxy.y());
+    points[numpoints].setX(vertices[numpoints - 1].x() - deltaxy.x());
+    points[numpoints].setY(vertices[numpoints - 1].y() - deltaxy.y());
+  }
+  else /* Extended end */
+  {
+    points[numpoints - 1].setX(vertices[numpoints - 1].x() + deltaxy.x() + deltaxy.y());
+    points[numpoints - 1].setY(vertices[numpoints - 1].y() + deltaxy.y() + deltaxy.x());
+    points[numpoints].setX(vertices[numpoints - 1].x() - deltaxy.x() + deltaxy.y());
+    points[numpoints].setY(vertices[numpoints - 1].y() - deltaxy.y() + deltaxy.x());
+  }
+  outpoints.append(points.toList());
+}
+
+
+void Path::lookupOutlinePoints(QList<QPointF> &points)
+{
+  outlineOf(vertices(), pathtype(), width(), points);
+}
+
+
+void Path::setAttributes(const QXmlStreamAttributes &attrs)
+{
+  PrimitiveElement::setAttributes(attrs);
+  _pathtype = attributeValue(attrs, "pathtype", "0").toInt();
+  _width = attributeValue(attrs, "width", "0.0").toFloat();
+}
+
+
+void Path::writeAttributes(QXmlStreamWriter &writer) const
+{
+  PrimitiveElement::writeAttributes(writer);
+  writer.writeAttribute("pathtype", QString::number(_pathtype));
+  writer.writeAttribute("width", numberText(_width));
+}
+
+
+void Path::storeRecord(ElementRecord &record, QString &name) const
+{
+  PrimitiveElement::storeRecord(record, name);
+  record.pathtype = _pathtype;
+  record.width = _width;
+}
+
+
+void Path::restoreRecord(const ElementRecord &record, const QString &name)
+{
+  PrimitiveElement::restoreRecord(record, name);
+  _pathtype = record.pathtype;
+  _width = record.width;
+}
+
+
+ReferenceElement::ReferenceElement()
+{
+  _mag = 1.0;
+  _angle = 0.0;
+  _reflected = false;
+  _mat = 0;
+}
+
+
+ReferenceElement::~ReferenceElement()
+{
+  delete _mat;
+  _mat = 0;
+}
+
+
+void ReferenceElement::clearGeometryCache()
+{
+  Element::clearGeometryCache();
+  delete _mat;
+  _mat = 0;
+}
+
+
+QPointF ReferenceElement::origin() const
+{
+  Q_ASSERT(! vertices().isEmpty());
+  return vertices().first();
+}
+
+
+void ReferenceElement::setAttributes(const QXmlStreamAttributes &attrs)
+{
+  Element::setAttributes(attrs);
+  _mag = attributeValue(attrs, "mag", "1.0").toDouble();
+  _angle = attributeValue(attrs, "angle", "0.0").toDouble();
+  _reflected = attributeValue(attrs, "reflected", "false") == QString("true");
+  if (_reflected) {
+    qDebug() << "MIRROR" << endl;
+  }
+  clearGeometryCache();
+}
+
+
+void ReferenceElement::writeAttributes(QXmlStreamWriter &writer) const
+{
+  Element::writeAttributes(writer);
+  writer.writeAttribute("mag", numberText(_mag));
+  writer.writeAttribute("angle", numberText(_angle));
+  writer.writeAttribute("reflected", _reflected ? "true" : "false");
+}
+
+
+void ReferenceElement::storeRecord(ElementRecord &record, QString &name) const
+{
+  Element::storeRecord(record, name);
+  record.mag = _mag;
+  record.angle = _angle;
+  record.reflected = _reflected ? 1 : 0;
+}
+
+
+void ReferenceElement::restoreRecord(const ElementRecord &record, const QString &name)
+{
+  Element::restoreRecord(record, name);
+  _mag = record.mag;
+  _angle = record.angle;
+  _reflected = record.reflected != 0;
+  clearGeometryCache();
+}
+
+
+QMatrix ReferenceElement::transform()
+{
+  if (_mat == nullptr) {
+    _mat = new QMatrix(transformOf(origin(), _mag, _angle, _reflected));
+  }
+  return *_mat;
+}
+
+
+// Placement of a reference by its attributes, for callers that have no
+// ReferenceElement at hand.
+QMatrix ReferenceElement::transformOf(const QPointF &origin, double mag, double angle,
+                                      bool reflected)
+{
+  qreal rad = angle * M_PI / 180.0;
+  qreal cos_rad = cos(rad);
+  qreal sin_rad = sin(rad);
+
+  qreal a =  mag * cos_rad;
+  qreal b = -mag * sin_rad;
+  qreal c = origin.x();
+  qreal d =  mag * sin_rad;
+  qreal e =  mag * cos_rad;
+  qreal f = origin.y();
+
+  /* GDSII understands only the Y mirroring */
+  /* Reflecting about X means changing *Y* */
+  if (reflected) {
+    b = -b;
+    e = -e;
+  }
+  QMatrix mat;
+  mat.setMatrix(a, d, b, e, c, f);
+  return mat;
+}
+
+
+void Sref::lookupOutlinePoints(QList<QPointF> &points)
+{
+  lookupOutlinePoints(transform(), points);
+}
+
+
+void Sref::lookupOutlinePoints(QMatrix mat, QList<QPointF> &points)
+{
+  if (referenceName().isEmpty()) {
+    qDebug() << "empty reference name" << endl;
+    return;
+  }
+  if (library() == nullptr) {
+    qDebug() << "library not bind" << endl;
+    return;
+  }
+  Structure *ref = library()->structureNamed(referenceName());
+  if (ref == nullptr) {
+    qDebug() << "structure not found: " << referenceName() << endl;
+    return;
+  }
+
+  QList<QPointF> outlinePoints;
+  Element::calcOutlinePoints(ref->dataBounds(), outlinePoints);
+
+  foreach (QPointF p, outlinePoints) {
+    points.append(mat.map(p));
+  }
+}
+
+
+void Sref::setAttributes(const QXmlStreamAttributes &attrs)
+{
+  ReferenceElement::setAttributes(attrs);
+  _referenceName = attributeValue(attrs, "sname", "").toUpper();
+}
+
+
+void Sref::writeAttributes(QXmlStreamWriter &writer) const
+{
+  ReferenceElement::writeAttributes(writer);
+  writer.writeAttribute("sname", _referenceName);
+}
+
+
+void Sref::storeRecord(ElementRecord &record, QString &name) const
+{
+  ReferenceElement::storeRecord(record, name);
+  name = _referenceName;
+}
+
+
+void Sref::restoreRecord(const ElementRecord &record, const QString &name)
+{
+  ReferenceElement::restoreRecord(record, name);
+  _referenceName = name;
+}
+
+
+Aref::Aref()
+{
+  _rowCount = 1;
+  _columnCount = 1;
+  _rowStep = 0.0;
+  _columnStep = 0.0;
+  _transforms = 0;
+}
+
+
+Aref::~Aref()
+{
+  delete _transforms;
+  _transforms = 0;
+}
+
+
+void Aref::clearGeometryCache()
+{
+  Sref::clearGeometryCache();
+  delete _transforms;
+  _transforms = 0;
+}
+
+
+bool Aref::readChildElement(QXmlStreamReader &reader)
+{
+  if (reader.name() != QLatin1String("ashape")) {
+    return Sref::readChildElement(reader);
+  }
+  QXmlStreamAttributes attrs = reader.attributes();
+  _rowCount = attributeValue(attrs, "rows", "1").toInt();
+  _columnCount = attributeValue(attrs, "cols", "1").toInt();
+  _rowStep = attributeValue(attrs, "row-spacing", "0.0").toDouble();
+  _columnStep = attributeValue(attrs, "column-spacing", "0.0").toDouble();
+  reader.skipCurrentElement();
+  clearGeometryCache();
+  return true;
+}
+
+
+void Aref::writeChildElements(QXmlStreamWriter &writer) const
+{
+  Sref::writeChildElements(writer);
+  writer.writeStartElement("ashape");
+  writer.writeAttribute("rows", QString::number(_rowCount));
+  writer.writeAttribute("cols", QString::number(_columnCount));
+  writer.writeAttribute("row-spacing", numberText(_rowStep));
+  writer.writeAttribute("column-spacing", numberText(_columnStep));
+  writer.writeEndElement();
+}
+
+
+void Aref::storeRecord(ElementRecord &record, QString &name) const
+{
+  Sref::storeRecord(record, name);
+  record.rowCount = _rowCount;
+  record.columnCount = _columnCount;
+  record.rowStep = _rowStep;
+  record.columnStep = _columnStep;
+}
+
+
+void Aref::restoreRecord(const ElementRecord &record, const QString &name)
+{
+  Sref::restoreRecord(record, name);
+  _rowCount = record.rowCount;
+  _columnCount = record.columnCount;
+  _rowStep = record.rowStep;
+  _columnStep = record.columnStep;
+  clearGeometryCache();
+}
+
+
+QList<QMatrix> Aref::transforms()
+{
+  if (_transforms == nullptr) {
+    _transforms = new QList<QMatrix>;
+    lookupTransforms(*_transforms);
+  }
+  return *_transforms;
+}
+
+
+// Outline of every placement. The offsets grow linearly with row and
+// column, so the four corner placements already reach the extremes.
+void Aref::lookupOutlinePoints(QList<QPointF> &points)
+{
+  QList<int> rows;
+  rows << 0 << qMax(0, _rowCount - 1);
+  QList<int> columns;
+  columns << 0 << qMax(0, _columnCount - 1);
+  foreach (int ri, rows) {
+    foreach (int ci, columns) {
+      QMatrix mat(transform());
+      mat.translate(ci * _columnStep, ri * _rowStep);
+      Sref::lookupOutlinePoints(mat, points);
+    }
+  }
+}
+
+
+void Aref::lookupTransforms(QList<QMatrix> &transforms)
+{
+  for (int ri = 0; ri < _rowCount; ri++) {
+    for (int ci = 0; ci < _columnCount; ci++) {
+      double xOffset = ci * _columnStep;
+      double yOffset = ri * _rowStep;
+      QMatrix copy(transform());
+      copy.translate(xOffset, yOffset);
+      transforms.append(copy);
+    }
+  }
+}
+
+
+} // namespace Gds
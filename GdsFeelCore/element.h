@@ -1,173 +1,234 @@
-#ifndef ELEMENT_H
-#define ELEMENT_H
-
-#include <QtCore/QList>
-#include <QtCore/QPointF>
-#include <QtXml>
-#include <QDomDocument>
-#include <QMatrix>
-
-namespace Gds {
-
-class Structure;
-class Library;
-
-
-class Element : public QObject
-{
-  Q_OBJECT
-
-public:
-  Element();
-  virtual ~Element();
-
-  Structure *structure();
-  Library *library();
-
-  QList<QPointF> vertices() const { return _vertices ;}
-  int keyNumber() const {return _keyNumber; }
-
-  void setVertices(const QList<QPointF> &vertices);  
-  virtual void setAttributes(QDomElement e);
-  QList<QPointF> outlinePoints();
-  QRectF dataBounds();
-
-  static Element* fromXmlElement(QDomElement e);  
-  static void resetToSmallBounds(QRectF &bounds);
-  static void calcDataBounds(QList<QPointF> points, QRectF &bounds);
-  static void calcOutlinePoints(QRectF bounds, QList<QPointF> &points);
-
-protected:
-  virtual void clearGeometryCache();
-  virtual void lookupOutlinePoints(QList<QPointF> &points);
-  virtual void lookupDataBounds(QRectF &bounds);
-
-private:
-  QList<QPointF> _vertices;
-  int _keyNumber;
-  QRectF *_dataBounds;
-  QList<QPointF> *_outlinePoints;
-};
-
-
-class PrimitiveElement : public Element
-{
-  Q_OBJECT
-public:
-  PrimitiveElement();
-
-  int datatype() const { return _datatype;}
-  int layerNumber() const { return _layerNumber;}
-  virtual void setAttributes(QDomElement e);
-
-private:
-  int _datatype;
-  int _layerNumber;
-};
-
-
-class Boundary : public PrimitiveElement
-{
-  Q_OBJECT
-};
-
-
-class Path : public PrimitiveElement
-{
-  Q_OBJECT
-public:
-  Path();
-
-  int pathtype() const { return _pathtype; }
-  double width() const { return _width; }
-  double halhWidth() const { return width() / 2.0; }
-
-  virtual void setAttributes(QDomElement e);
-
-protected:
-  virtual void lookupOutlinePoints(QList<QPointF> &points);
-
-private:
-  int _pathtype;
-  double _width;
-};
-
-
-class ReferenceElement : public Element
-{
-  Q_OBJECT
-protected:
-    ReferenceElement();
-    virtual ~ReferenceElement();
-
-public:
-  double mag() const {return _mag;}
-  double angle() const {return _angle;}
-  QPointF origin() const;
-  bool  reflected() const {return _reflected;}
-  virtual void setAttributes(QDomElement e);
-  QMatrix transform();
-
-protected:
-  virtual void clearGeometryCache();
-
-private:
-   void getTransform(QMatrix &mat);
-
-
-private:
-  double _mag;
-  double _angle;
-  bool _reflected;
-  QMatrix *_mat;
-};
-
-
-class Sref : public ReferenceElement
-{
-  Q_OBJECT
-public:
-  QString referenceName() const {return _referenceName;}
-  virtual void setAttributes(QDomElement e);
-
-  void lookupOutlinePoints(QMatrix mat, QList<QPointF> &points);
-
-protected:
-  virtual void lookupOutlinePoints(QList<QPointF> &points);
-
-private:
-  QString _referenceName;
-};
-
-
-class Aref : public Sref
-{
-  Q_OBJECT
-public:
-    Aref();
-    virtual ~Aref();
-
-  int rowCount() const {return _rowCount;}
-  int columnCount() const {return _columnCount;}
-  double rowStep() const {return _rowStep;}
-  double columnStep() const {return _columnStep;}
-  QList<QMatrix> transforms();
-
-  virtual void setAttributes(QDomElement e);
-
-protected:
-  virtual void clearGeometryCache();
-  void lookupTransforms(QList<QMatrix> &transforms);
-
-private:
-  int _rowCount;
-  int _columnCount;
-  double _rowStep;
-  double _columnStep;
-  QList<QMatrix> *_transforms;
-};
-
-
-} // namespace Gds
-
-#endif // ELEMENT_H
+#ifndef ELEMENT_H
+#define ELEMENT_H
+
+#include <QtCore/QList>
+#include <QtCore/QPointF>
+#include <QtCore/QXmlStreamReader>
+#include <QtCore/QXmlStreamWriter>
+#include <QMatrix>
+
+namespace Gds {
+
+class Structure;
+class Library;
+
+
+// Fixed-size image of an element's attributes, as kept by
+// StructureCache. Vertices and the reference name live beside it.
+struct ElementRecord
+{
+  quint8 kind;
+  quint8 reflected;
+  quint16 reserved;
+  qint32 keyNumber;
+  qint32 layerNumber;
+  qint32 datatype;
+  qint32 pathtype;
+  qint32 rowCount;
+  qint32 columnCount;
+  quint32 firstCoordinate;
+  quint32 vertexCount;
+  quint32 nameOffset;
+  quint32 nameLength;
+  quint32 padding;
+  double width;
+  double mag;
+  double angle;
+  double rowStep;
+  double columnStep;
+};
+
+
+class Element : public QObject
+{
+  Q_OBJECT
+
+public:
+  enum Kind { UnknownKind, BoundaryKind, PathKind, SrefKind, ArefKind };
+
+  Element();
+  virtual ~Element();
+
+  Structure *structure();
+  Library *library();
+
+  QList<QPointF> vertices() const { return _vertices ;}
+  int keyNumber() const {return _keyNumber; }
+  virtual Kind kind() const { return UnknownKind; }
+
+  void setVertices(const QList<QPointF> &vertices);  
+  virtual void setAttributes(const QXmlStreamAttributes &attrs);
+  virtual bool readChildElement(QXmlStreamReader &reader);
+  virtual void storeRecord(ElementRecord &record, QString &name) const;
+  virtual void restoreRecord(const ElementRecord &record, const QString &name);
+  virtual void writeAttributes(QXmlStreamWriter &writer) const;
+  virtual void writeChildElements(QXmlStreamWriter &writer) const;
+  void toXmlStream(QXmlStreamWriter &writer) const;
+  QList<QPointF> outlinePoints();
+  QRectF dataBounds();
+
+  static Element* fromXmlStream(QXmlStreamReader &reader);
+  static Element* fromRecord(const ElementRecord &record, const QString &name,
+                             const double *coordinates);
+  static void resetToSmallBounds(QRectF &bounds);
+  static void calcDataBounds(QList<QPointF> points, QRectF &bounds);
+  static void calcOutlinePoints(QRectF bounds, QList<QPointF> &points);
+
+protected:
+  virtual void clearGeometryCache();
+  virtual void lookupOutlinePoints(QList<QPointF> &points);
+  virtual void lookupDataBounds(QRectF &bounds);
+  void readVertices(QXmlStreamReader &reader);
+
+private:
+  QList<QPointF> _vertices;
+  int _keyNumber;
+  QRectF *_dataBounds;
+  QList<QPointF> *_outlinePoints;
+};
+
+
+class PrimitiveElement : public Element
+{
+  Q_OBJECT
+public:
+  PrimitiveElement();
+
+  int datatype() const { return _datatype;}
+  int layerNumber() const { return _layerNumber;}
+  virtual void setAttributes(const QXmlStreamAttributes &attrs);
+  virtual void storeRecord(ElementRecord &record, QString &name) const;
+  virtual void restoreRecord(const ElementRecord &record, const QString &name);
+  virtual void writeAttributes(QXmlStreamWriter &writer) const;
+
+private:
+  int _datatype;
+  int _layerNumber;
+};
+
+
+class Boundary : public PrimitiveElement
+{
+  Q_OBJECT
+public:
+  virtual Kind kind() const { return BoundaryKind; }
+};
+
+
+class Path : public PrimitiveElement
+{
+  Q_OBJECT
+public:
+  Path();
+
+  int pathtype() const { return _pathtype; }
+  double width() const { return _width; }
+  double halhWidth() const { return width() / 2.0; }
+  virtual Kind kind() const { return PathKind; }
+
+  static void outlineOf(const QList<QPointF> &vertices, int pathtype, double width,
+                        QList<QPointF> &points);
+
+  virtual void setAttributes(const QXmlStreamAttributes &attrs);
+  virtual void storeRecord(ElementRecord &record, QString &name) const;
+  virtual void restoreRecord(const ElementRecord &record, const QString &name);
+  virtual void writeAttributes(QXmlStreamWriter &writer) const;
+
+protected:
+  virtual void lookupOutlinePoints(QList<QPointF> &points);
+
+private:
+  int _pathtype;
+  double _width;
+};
+
+
+class ReferenceElement : public Element
+{
+  Q_OBJECT
+protected:
+    ReferenceElement();
+    virtual ~ReferenceElement();
+
+public:
+  double mag() const {return _mag;}
+  double angle() const {return _angle;}
+  QPointF origin() const;
+  bool  reflected() const {return _reflected;}
+  virtual void setAttributes(const QXmlStreamAttributes &attrs);
+  virtual void storeRecord(ElementRecord &record, QString &name) const;
+  virtual void restoreRecord(const ElementRecord &record, const QString &name);
+  virtual void writeAttributes(QXmlStreamWriter &writer) const;
+  QMatrix transform();
+
+  static QMatrix transformOf(const QPointF &origin, double mag, double angle, bool reflected);
+
+protected:
+  virtual void clearGeometryCache();
+
+
+private:
+  double _mag;
+  double _angle;
+  bool _reflected;
+  QMatrix *_mat;
+};
+
+
+class Sref : public ReferenceElement
+{
+  Q_OBJECT
+public:
+  QString referenceName() const {return _referenceName;}
+  virtual Kind kind() const { return SrefKind; }
+  virtual void setAttributes(const QXmlStreamAttributes &attrs);
+  virtual void storeRecord(ElementRecord &record, QString &name) const;
+  virtual void restoreRecord(const ElementRecord &record, const QString &name);
+  virtual void writeAttributes(QXmlStreamWriter &writer) const;
+
+  void lookupOutlinePoints(QMatrix mat, QList<QPointF> &points);
+
+protected:
+  virtual void lookupOutlinePoints(QList<QPointF> &points);
+
+private:
+  QString _referenceName;
+};
+
+
+class Aref : public Sref
+{
+  Q_OBJECT
+public:
+    Aref();
+    virtual ~Aref();
+
+  int rowCount() const {return _rowCount;}
+  int columnCount() const {return _columnCount;}
+  double rowStep() const {return _rowStep;}
+  double columnStep() const {return _columnStep;}
+  QList<QMatrix> transforms();
+  virtual Kind kind() const { return ArefKind; }
+
+  virtual bool readChildElement(QXmlStreamReader &reader);
+  virtual void storeRecord(ElementRecord &record, QString &name) const;
+  virtual void restoreRecord(const ElementRecord &record, const QString &name);
+  virtual void writeChildElements(QXmlStreamWriter &writer) const;
+
+protected:
+  virtual void clearGeometryCache();
+  virtual void lookupOutlinePoints(QList<QPointF> &points);
+  void lookupTransforms(QList<QMatrix> &transforms);
+
+private:
+  int _rowCount;
+  int _columnCount;
+  double _rowStep;
+  double _columnStep;
+  QList<QMatrix> *_transforms;
+};
+
+
+} // namespace Gds
+
+#endif // ELEMENT_H
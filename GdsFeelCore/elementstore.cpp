@@ -0,0 +1,393 @@
+#include <string.h>
+
+#include "elementstore.h"
+
+namespace Gds {
+
+Element::Kind ElementView::kind() const
+{
+  return static_cast<Element::Kind>(_store->_kinds.at(_index));
+}
+
+
+bool ElementView::isPrimitive() const
+{
+  return kind() == Element::BoundaryKind || kind() == Element::PathKind;
+}
+
+
+bool ElementView::isReference() const
+{
+  return kind() == Element::SrefKind || kind() == Element::ArefKind;
+}
+
+
+int ElementView::keyNumber() const
+{
+  return _store->_keyNumbers.at(_index);
+}
+
+
+int ElementView::layerNumber() const
+{
+  return _store->_layers.at(_index);
+}
+
+
+int ElementView::datatype() const
+{
+  return _store->_datatypes.at(_index);
+}
+
+
+int ElementView::vertexCount() const
+{
+  return _store->_vertexCounts.at(_index);
+}
+
+
+// x, y pairs of this element inside the store's coordinate buffer.
+const double *ElementView::coordinates() const
+{
+  return _store->_coordinates.constData() + _store->_firstCoordinates.at(_index);
+}
+
+
+QPointF ElementView::vertex(int i) const
+{
+  const double *xy = coordinates() + 2 * i;
+  return QPointF(xy[0], xy[1]);
+}
+
+
+QList<QPointF> ElementView::vertices() const
+{
+  QList<QPointF> points;
+  int count = vertexCount();
+  points.reserve(count);
+  for (int i = 0; i < count; i++) {
+    points.append(vertex(i));
+  }
+  return points;
+}
+
+
+// Outline of a primitive as Element::outlinePoints() gives it: the
+// vertices of a boundary, the widened outline of a path.
+QList<QPointF> ElementView::outlinePoints() const
+{
+  QList<QPointF> points = vertices();
+  if (kind() == Element::PathKind) {
+    QList<QPointF> outline;
+    Path::outlineOf(points, pathtype(), width(), outline);
+    return outline;
+  }
+  return points;
+}
+
+
+// Bounds of a primitive's outline; references have none here, their
+// bounds depend on the referenced structure.
+QRectF ElementView::dataBounds() const
+{
+  return _store->_bounds.at(_index);
+}
+
+
+int ElementView::pathtype() const
+{
+  int extra = _store->_extras.at(_index);
+  return kind() == Element::PathKind ? _store->_paths.at(extra).pathtype : 0;
+}
+
+
+double ElementView::width() const
+{
+  int extra = _store->_extras.at(_index);
+  return kind() == Element::PathKind ? _store->_paths.at(extra).width : 0.0;
+}
+
+
+QString ElementView::referenceName() const
+{
+  return isReference() ? _store->_references.at(_store->_extras.at(_index)).name : QString();
+}
+
+
+double ElementView::mag() const
+{
+  return isReference() ? _store->_references.at(_store->_extras.at(_index)).mag : 1.0;
+}
+
+
+double ElementView::angle() const
+{
+  return isReference() ? _store->_references.at(_store->_extras.at(_index)).angle : 0.0;
+}
+
+
+bool ElementView::reflected() const
+{
+  return isReference() ? _store->_references.at(_store->_extras.at(_index)).reflected : false;
+}
+
+
+int ElementView::rowCount() const
+{
+  return kind() == Element::ArefKind ? _store->_references.at(_store->_extras.at(_index)).rowCount : 1;
+}
+
+
+int ElementView::columnCount() const
+{
+  return kind() == Element::ArefKind ? _store->_references.at(_store->_extras.at(_index)).columnCount : 1;
+}
+
+
+double ElementView::rowStep() const
+{
+  return kind() == Element::ArefKind ? _store->_references.at(_store->_extras.at(_index)).rowStep : 0.0;
+}
+
+
+double ElementView::columnStep() const
+{
+  return kind() == Element::ArefKind ? _store->_references.at(_store->_extras.at(_index)).columnStep : 0.0;
+}
+
+
+// Same as ReferenceElement::transform() of the materialized element.
+QMatrix ElementView::transform() const
+{
+  return ReferenceElement::transformOf(vertex(0), mag(), angle(), reflected());
+}
+
+
+// Every placement, row by row, as Aref::transforms(); a Sref has one.
+QList<QMatrix> ElementView::transforms() const
+{
+  QList<QMatrix> result;
+  for (int ri = 0; ri < rowCount(); ri++) {
+    for (int ci = 0; ci < columnCount(); ci++) {
+      QMatrix mat(transform());
+      mat.translate(ci * columnStep(), ri * rowStep());
+      result.append(mat);
+    }
+  }
+  return result;
+}
+
+
+ElementStore::ElementStore()
+{
+}
+
+
+void ElementStore::clear()
+{
+  _kinds.clear();
+  _keyNumbers.clear();
+  _layers.clear();
+  _datatypes.clear();
+  _firstCoordinates.clear();
+  _vertexCounts.clear();
+  _extras.clear();
+  _bounds.clear();
+  _coordinates.clear();
+  _paths.clear();
+  _references.clear();
+}
+
+
+// Gives back the slack left by appending, once the store is complete.
+void ElementStore::squeeze()
+{
+  _kinds.squeeze();
+  _keyNumbers.squeeze();
+  _layers.squeeze();
+  _datatypes.squeeze();
+  _firstCoordinates.squeeze();
+  _vertexCounts.squeeze();
+  _extras.squeeze();
+  _bounds.squeeze();
+  _coordinates.squeeze();
+  _paths.squeeze();
+  _references.squeeze();
+}
+
+
+qint64 ElementStore::memoryUsage() const
+{
+  qint64 bytes = 0;
+  bytes += _kinds.capacity() * sizeof(quint8);
+  bytes += (_keyNumbers.capacity() + _layers.capacity() + _datatypes.capacity()
+            + _extras.capacity()) * sizeof(qint32);
+  bytes += (_firstCoordinates.capacity() + _vertexCounts.capacity()) * sizeof(quint32);
+  bytes += _bounds.capacity() * sizeof(QRectF);
+  bytes += _coordinates.capacity() * sizeof(double);
+  bytes += _paths.capacity() * sizeof(PathData);
+  bytes += _references.capacity() * sizeof(ReferenceData);
+  return bytes;
+}
+
+
+void ElementStore::append(const Element *element)
+{
+  ElementRecord record;
+  memset(&record, 0, sizeof(record));
+  QString name;
+  element->storeRecord(record, name);
+  QVector<double> coordinates;
+  coordinates.reserve(2 * record.vertexCount);
+  foreach (const QPointF &pt, element->vertices()) {
+    coordinates.append(pt.x());
+    coordinates.append(pt.y());
+  }
+  append(record, name, coordinates.constData());
+}
+
+
+// coordinates holds the record's vertices as x, y pairs.
+void ElementStore::append(const ElementRecord &record, const QString &name,
+                          const double *coordinates)
+{
+  appendRecord(record, name, coordinates);
+  _bounds.append(lookupBounds(size() - 1));
+}
+
+
+// Puts the data of element in place of entry index.
+void ElementStore::replace(int index, const Element *element)
+{
+  rewrite(index, element);
+}
+
+
+void ElementStore::remove(int index)
+{
+  rewrite(index, 0);
+}
+
+
+// Everything of append() but the bounds.
+void ElementStore::appendRecord(const ElementRecord &record, const QString &name,
+                                const double *coordinates)
+{
+  _kinds.append(record.kind);
+  _keyNumbers.append(record.keyNumber);
+  _layers.append(record.layerNumber);
+  _datatypes.append(record.datatype);
+  _firstCoordinates.append(_coordinates.size());
+  _vertexCounts.append(record.vertexCount);
+  int first = _coordinates.size();
+  _coordinates.resize(first + 2 * record.vertexCount);
+  memcpy(_coordinates.data() + first, coordinates, 2 * record.vertexCount * sizeof(double));
+
+  int extra = -1;
+  if (record.kind == Element::PathKind) {
+    PathData path;
+    path.pathtype = record.pathtype;
+    path.width = record.width;
+    extra = _paths.size();
+    _paths.append(path);
+  }
+  else if (record.kind == Element::SrefKind || record.kind == Element::ArefKind) {
+    ReferenceData ref;
+    ref.name = name;
+    ref.mag = record.mag;
+    ref.angle = record.angle;
+    ref.reflected = record.reflected != 0;
+    ref.rowCount = record.rowCount;
+    ref.columnCount = record.columnCount;
+    ref.rowStep = record.rowStep;
+    ref.columnStep = record.columnStep;
+    extra = _references.size();
+    _references.append(ref);
+  }
+  _extras.append(extra);
+}
+
+
+// Copies the store with entry index replaced by element, or left out
+// when element is null. The side tables and the coordinate buffer are
+// shared by all entries, so they are rebuilt rather than patched; the
+// bounds of the other entries are copied, not computed again.
+void ElementStore::rewrite(int index, const Element *element)
+{
+  if (index < 0 || index >= size()) {
+    return;
+  }
+  ElementStore result;
+  for (int i = 0; i < size(); i++) {
+    if (i != index) {
+      QString name;
+      ElementRecord record = recordAt(i, name);
+      result.appendRecord(record, name, at(i).coordinates());
+      result._bounds.append(_bounds.at(i));
+    }
+    else if (element != nullptr) {
+      result.append(element);
+    }
+  }
+  result.squeeze();
+  *this = result;
+}
+
+
+// Same bounds Element::dataBounds() gives for the primitive.
+QRectF ElementStore::lookupBounds(int index) const
+{
+  ElementView view = at(index);
+  if (! view.isPrimitive()) {
+    return QRectF();
+  }
+  QRectF bounds;
+  Element::calcDataBounds(view.outlinePoints(), bounds);
+  return bounds;
+}
+
+
+// The record the entry was appended from; fields that do not belong to
+// its kind are zero, as Element::storeRecord() leaves them.
+ElementRecord ElementStore::recordAt(int index, QString &name) const
+{
+  ElementRecord record;
+  memset(&record, 0, sizeof(record));
+  record.kind = _kinds.at(index);
+  record.keyNumber = _keyNumbers.at(index);
+  record.layerNumber = _layers.at(index);
+  record.datatype = _datatypes.at(index);
+  record.firstCoordinate = _firstCoordinates.at(index);
+  record.vertexCount = _vertexCounts.at(index);
+  name.clear();
+  int extra = _extras.at(index);
+  if (record.kind == Element::PathKind) {
+    const PathData &path = _paths.at(extra);
+    record.pathtype = path.pathtype;
+    record.width = path.width;
+  }
+  else if (record.kind == Element::SrefKind || record.kind == Element::ArefKind) {
+    const ReferenceData &ref = _references.at(extra);
+    record.mag = ref.mag;
+    record.angle = ref.angle;
+    record.reflected = ref.reflected ? 1 : 0;
+    record.rowCount = ref.rowCount;
+    record.columnCount = ref.columnCount;
+    record.rowStep = ref.rowStep;
+    record.columnStep = ref.columnStep;
+    name = ref.name;
+  }
+  return record;
+}
+
+
+// Builds the Element object for one entry, for code that needs the
+// QObject form.
+Element *ElementStore::materialize(int index) const
+{
+  QString name;
+  ElementRecord record = recordAt(index, name);
+  return Element::fromRecord(record, name, at(index).coordinates());
+}
+
+} // namespace Gds
@@ -0,0 +1,122 @@
+#ifndef ELEMENTSTORE_H
+#define ELEMENTSTORE_H
+
+#include <QtCore/QRectF>
+#include <QtCore/QVector>
+
+#include "element.h"
+
+namespace Gds {
+
+class ElementStore;
+
+
+// A light handle on one element of an ElementStore. It stays valid as
+// long as the store is not changed.
+class ElementView
+{
+public:
+  ElementView(const ElementStore *store, int index) : _store(store), _index(index) {}
+
+  int index() const { return _index; }
+  Element::Kind kind() const;
+  bool isPrimitive() const;
+  bool isReference() const;
+  int keyNumber() const;
+  int layerNumber() const;
+  int datatype() const;
+
+  int vertexCount() const;
+  const double *coordinates() const;
+  QPointF vertex(int i) const;
+  QList<QPointF> vertices() const;
+  QList<QPointF> outlinePoints() const;
+  QRectF dataBounds() const;
+
+  int pathtype() const;
+  double width() const;
+
+  QString referenceName() const;
+  double mag() const;
+  double angle() const;
+  bool reflected() const;
+  int rowCount() const;
+  int columnCount() const;
+  double rowStep() const;
+  double columnStep() const;
+  QMatrix transform() const;
+  QList<QMatrix> transforms() const;
+
+private:
+  const ElementStore *_store;
+  int _index;
+};
+
+
+// The elements of a structure as parallel arrays: kind, layer,
+// datatype and key number per element, every vertex in one coordinate
+// buffer, and the few path and reference attributes in side tables.
+// This is the form a loaded structure keeps its elements in; Element
+// objects are only built on request, by materialize(), for editing.
+class ElementStore
+{
+public:
+  ElementStore();
+
+  int size() const { return _kinds.size(); }
+  bool isEmpty() const { return _kinds.isEmpty(); }
+  ElementView at(int index) const { return ElementView(this, index); }
+  qint64 memoryUsage() const;
+
+  void clear();
+  void squeeze();
+  void append(const Element *element);
+  void append(const ElementRecord &record, const QString &name, const double *coordinates);
+  void replace(int index, const Element *element);
+  void remove(int index);
+
+  ElementRecord recordAt(int index, QString &name) const;
+  Element *materialize(int index) const;
+  const QVector<double> &coordinates() const { return _coordinates; }
+
+private:
+  friend class ElementView;
+
+  struct PathData
+  {
+    qint32 pathtype;
+    double width;
+  };
+
+  struct ReferenceData
+  {
+    QString name;
+    double mag;
+    double angle;
+    bool reflected;
+    qint32 rowCount;
+    qint32 columnCount;
+    double rowStep;
+    double columnStep;
+  };
+
+  void appendRecord(const ElementRecord &record, const QString &name, const double *coordinates);
+  void rewrite(int index, const Element *element);
+  QRectF lookupBounds(int index) const;
+
+  QVector<quint8> _kinds;
+  QVector<qint32> _keyNumbers;
+  QVector<qint32> _layers;
+  QVector<qint32> _datatypes;
+  QVector<quint32> _firstCoordinates;
+  QVector<quint32> _vertexCounts;
+  QVector<qint32> _extras;
+  QVector<QRectF> _bounds;
+  QVector<double> _coordinates;
+  QVector<PathData> _paths;
+  QVector<ReferenceData> _references;
+};
+
+} // namespace Gds
+
+#endif // ELEMENTSTORE_H
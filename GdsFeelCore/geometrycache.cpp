@@ -0,0 +1,124 @@
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QtAlgorithms>
+
+#include "geometrycache.h"
+#include "structure.h"
+
+namespace Gds {
+
+const qint64 DEFAULT_BUDGET = 512 * 1024 * 1024;
+
+GeometryCache::GeometryCache()
+{
+  _budget = DEFAULT_BUDGET;
+  _usage = 0;
+  _tick = 0;
+  resetCounters();
+}
+
+
+void GeometryCache::setBudget(qint64 bytes)
+{
+  _budget = bytes;
+  trim(0);
+}
+
+
+void GeometryCache::resetCounters()
+{
+  _hits = 0;
+  _misses = 0;
+  _evictions = 0;
+}
+
+
+void GeometryCache::hit(Structure *structure)
+{
+  _hits++;
+  touch(structure);
+}
+
+
+void GeometryCache::touch(Structure *structure)
+{
+  _lastUse[structure] = ++_tick;
+}
+
+
+// Takes a structure whose elements were just read.
+void GeometryCache::admit(Structure *structure)
+{
+  _misses++;
+  resize(structure);
+}
+
+
+// Takes the current cost of a loaded structure, after a load or an
+// edit, and unloads others if that goes over budget.
+void GeometryCache::resize(Structure *structure)
+{
+  qint64 cost = structure->geometryCost();
+  _usage += cost - _costs.value(structure, 0);
+  _costs[structure] = cost;
+  _lastUse[structure] = ++_tick;
+  trim(structure);
+}
+
+
+// Keeps structure loaded until a matching unpin(); pins nest.
+void GeometryCache::pin(Structure *structure)
+{
+  _pins[structure]++;
+}
+
+
+void GeometryCache::unpin(Structure *structure)
+{
+  if (! _pins.contains(structure)) {
+    return;
+  }
+  if (--_pins[structure] == 0) {
+    _pins.remove(structure);
+    trim(0);
+  }
+}
+
+
+// Forgets every structure without unloading it, for when the library
+// releases its structures.
+void GeometryCache::clear()
+{
+  _lastUse.clear();
+  _costs.clear();
+  _pins.clear();
+  _usage = 0;
+}
+
+
+// Unloads structures, oldest use first, until usage fits the budget.
+// keep, pinned and dirty structures are never unloaded.
+void GeometryCache::trim(Structure *keep)
+{
+  if (_usage <= _budget) {
+    return;
+  }
+  QList<QPair<quint64, Structure*> > candidates;
+  QHashIterator<Structure*, quint64> iter(_lastUse);
+  while (iter.hasNext()) {
+    iter.next();
+    if (iter.key() != keep && ! _pins.contains(iter.key()) && ! iter.key()->isDirty()) {
+      candidates.append(qMakePair(iter.value(), iter.key()));
+    }
+  }
+  qSort(candidates);
+  for (int i = 0; i < candidates.size() && _usage > _budget; i++) {
+    Structure *victim = candidates.at(i).second;
+    if (! victim->unload()) continue;
+    _usage -= _costs.take(victim);
+    _lastUse.remove(victim);
+    _evictions++;
+  }
+}
+
+} // namespace Gds
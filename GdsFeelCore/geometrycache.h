@@ -0,0 +1,61 @@
+#ifndef GEOMETRYCACHE_H
+#define GEOMETRYCACHE_H
+
+#include <QtCore/QHash>
+
+namespace Gds {
+
+class Structure;
+
+// Keeps the element geometry of a library's structures within a memory
+// budget. Every library has its own cache, so the budget is per library,
+// not for the process. Loaded structures are tracked by last use; when a
+// load goes over budget, the least recently used ones are unloaded. They
+// keep their names, headers and bounds, and load again on demand.
+//
+// hits() and misses() count Structure::load() calls only: a miss reads
+// the elements, a hit finds them loaded. Accessors that load on demand
+// update the last use without counting.
+//
+// Eviction happens inside Structure::load(), so the elements() of other
+// structures must not be kept across a load, unless those structures
+// are pinned.
+class GeometryCache
+{
+public:
+  GeometryCache();
+
+  qint64 budget() const { return _budget; }
+  void setBudget(qint64 bytes);
+  qint64 usage() const { return _usage; }
+
+  int hits() const { return _hits; }
+  int misses() const { return _misses; }
+  int evictions() const { return _evictions; }
+  void resetCounters();
+
+  void hit(Structure *structure);
+  void touch(Structure *structure);
+  void admit(Structure *structure);
+  void resize(Structure *structure);
+  void pin(Structure *structure);
+  void unpin(Structure *structure);
+  void clear();
+
+private:
+  void trim(Structure *keep);
+
+  qint64 _budget;
+  qint64 _usage;
+  quint64 _tick;
+  int _hits;
+  int _misses;
+  int _evictions;
+  QHash<Structure*, quint64> _lastUse;
+  QHash<Structure*, qint64> _costs;
+  QHash<Structure*, int> _pins;
+};
+
+} // namespace Gds
+
+#endif // GEOMETRYCACHE_H
@@ -0,0 +1,276 @@
+#include <QtCore/QDebug>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+#include "hierarchy.h"
+#include "library.h"
+
+namespace Gds {
+
+Hierarchy::Hierarchy(Library *library)
+{
+  build(library);
+  sortLevels();
+}
+
+
+// Parses the headers of unloaded structures, claiming them one by one
+// from a shared counter.
+class HeaderTask : public QRunnable
+{
+public:
+  HeaderTask(const QList<Structure*> &structures, const QList<int> &pending,
+             StructureHeader *headers, QAtomicInt *next)
+    : _structures(structures), _pending(pending), _headers(headers), _next(next) {}
+
+  void run()
+  {
+    for (;;) {
+      int n = _next->fetchAndAddOrdered(1);
+      if (n >= _pending.size()) {
+        break;
+      }
+      int i = _pending.at(n);
+      _headers[i] = _structures.at(i)->parseHeader();
+    }
+  }
+
+private:
+  const QList<Structure*> &_structures;
+  const QList<int> &_pending;
+  StructureHeader *_headers;
+  QAtomicInt *_next;
+};
+
+
+// Headers not known yet are parsed concurrently, since without a
+// sidecar cache that means parsing the whole structure.
+void Hierarchy::build(Library *library)
+{
+  QList<Structure*> structures = library->structures();
+  _headers.resize(structures.size());
+  QList<int> pending;
+  for (int i = 0; i < structures.size(); i++) {
+    Structure *s = structures.at(i);
+    _index.insert(s->name(), i);
+    _names.append(s->name());
+    if (s->hasHeader() || s->isLoaded()) {
+      _headers[i] = s->header();
+    }
+    else {
+      pending.append(i);
+    }
+  }
+  int workerCount = qMin(QThread::idealThreadCount(), pending.size());
+  if (workerCount > 1) {
+    QAtomicInt next(0);
+    QThreadPool pool;
+    pool.setMaxThreadCount(workerCount);
+    for (int t = 0; t < workerCount; t++) {
+      pool.start(new HeaderTask(structures, pending, _headers.data(), &next));
+    }
+    pool.waitForDone();
+  }
+  else {
+    foreach (int i, pending) {
+      _headers[i] = structures.at(i)->parseHeader();
+    }
+  }
+  foreach (int i, pending) {
+    structures.at(i)->setHeader(_headers.at(i));
+  }
+  _children.resize(_names.size());
+  _parents.resize(_names.size());
+  for (int i = 0; i < _names.size(); i++) {
+    foreach (QString refName, _headers.at(i).referenceNames()) {
+      int child = _index.value(refName, -1);
+      if (child < 0) {
+        qDebug() << "structure not found: " << refName << endl;
+        continue;
+      }
+      _children[i].append(child);
+      _parents[child].append(i);
+    }
+  }
+}
+
+
+// Kahn's algorithm, taking one whole level of ready structures at a time.
+void Hierarchy::sortLevels()
+{
+  QVector<int> pending(_names.size());
+  QList<int> ready;
+  for (int i = 0; i < _names.size(); i++) {
+    pending[i] = _children.at(i).size();
+    if (pending[i] == 0) {
+      ready.append(i);
+    }
+  }
+  int sorted = 0;
+  while (! ready.isEmpty()) {
+    _levels.append(ready);
+    sorted += ready.size();
+    QList<int> next;
+    foreach (int i, ready) {
+      foreach (int parent, _parents.at(i)) {
+        if (--pending[parent] == 0) {
+          next.append(parent);
+        }
+      }
+    }
+    ready = next;
+  }
+  if (sorted == _names.size()) {
+    return;
+  }
+  for (int i = 0; i < _names.size(); i++) {
+    if (pending.at(i) > 0) {
+      _cyclic.append(i);
+    }
+  }
+  qDebug() << "reference cycle: " << cyclic() << endl;
+}
+
+
+QStringList Hierarchy::namesOf(const QList<int> &indices) const
+{
+  QStringList result;
+  foreach (int i, indices) {
+    result.append(_names.at(i));
+  }
+  return result;
+}
+
+
+QStringList Hierarchy::names() const
+{
+  return _names;
+}
+
+
+QStringList Hierarchy::children(const QString &name) const
+{
+  int i = _index.value(name, -1);
+  return i < 0 ? QStringList() : namesOf(_children.at(i));
+}
+
+
+QStringList Hierarchy::parents(const QString &name) const
+{
+  int i = _index.value(name, -1);
+  return i < 0 ? QStringList() : namesOf(_parents.at(i));
+}
+
+
+QStringList Hierarchy::topStructures() const
+{
+  QList<int> tops;
+  for (int i = 0; i < _names.size(); i++) {
+    if (_parents.at(i).isEmpty()) {
+      tops.append(i);
+    }
+  }
+  return namesOf(tops);
+}
+
+
+QList<QStringList> Hierarchy::levels() const
+{
+  QList<QStringList> result;
+  foreach (const QList<int> &level, _levels) {
+    result.append(namesOf(level));
+  }
+  return result;
+}
+
+
+QStringList Hierarchy::topologicalOrder() const
+{
+  QStringList result;
+  foreach (const QList<int> &level, _levels) {
+    result.append(namesOf(level));
+  }
+  return result;
+}
+
+
+bool Hierarchy::hasCycle() const
+{
+  return ! _cyclic.isEmpty();
+}
+
+
+QStringList Hierarchy::cyclic() const
+{
+  return namesOf(_cyclic);
+}
+
+
+// Computes the bounds of a slice of one level. The structures it
+// references are all on lower levels, so their bounds are final.
+class LevelBoundsTask : public QRunnable
+{
+public:
+  LevelBoundsTask(const QVector<StructureHeader> &headers, const QStringList &names,
+                  const QVector<QList<int> > &children, QRectF *bounds,
+                  const QList<int> &level, int begin, int end)
+    : _headers(headers), _names(names), _children(children), _bounds(bounds),
+      _level(level), _begin(begin), _end(end) {}
+
+  void run()
+  {
+    for (int n = _begin; n < _end; n++) {
+      int i = _level.at(n);
+      QHash<QString, QRectF> referenceBounds;
+      foreach (int child, _children.at(i)) {
+        referenceBounds.insert(_names.at(child), _bounds[child]);
+      }
+      _bounds[i] = _headers.at(i).bounds(referenceBounds);
+    }
+  }
+
+private:
+  const QVector<StructureHeader> &_headers;
+  const QStringList &_names;
+  const QVector<QList<int> > &_children;
+  QRectF *_bounds;
+  const QList<int> &_level;
+  int _begin;
+  int _end;
+};
+
+
+// One pass over the levels; the structures of a level are split across
+// workerCount threads. Cyclic structures are left out.
+QHash<QString, QRectF> Hierarchy::computeBounds(int workerCount) const
+{
+  const int minSlice = 16;
+  QVector<QRectF> bounds(_names.size());
+  QThreadPool pool;
+  pool.setMaxThreadCount(qMax(1, workerCount));
+  foreach (const QList<int> &level, _levels) {
+    int slice = qMax(minSlice, (level.size() + workerCount - 1) / qMax(1, workerCount));
+    if (workerCount <= 1 || level.size() <= minSlice) {
+      LevelBoundsTask(_headers, _names, _children, bounds.data(), level, 0, level.size()).run();
+      continue;
+    }
+    for (int begin = 0; begin < level.size(); begin += slice) {
+      int end = qMin(begin + slice, level.size());
+      pool.start(new LevelBoundsTask(_headers, _names, _children, bounds.data(),
+                                     level, begin, end));
+    }
+    pool.waitForDone();
+  }
+
+  QHash<QString, QRectF> result;
+  foreach (const QList<int> &level, _levels) {
+    foreach (int i, level) {
+      result.insert(_names.at(i), bounds.at(i));
+    }
+  }
+  return result;
+}
+
+} // namespace Gds
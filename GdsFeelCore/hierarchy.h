@@ -0,0 +1,50 @@
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+#include "structure.h"
+
+namespace Gds {
+
+class Library;
+
+// The reference graph of a library, built from the structure headers.
+// Structures are ordered bottom-up in levels: level 0 references
+// nothing, and every structure comes after all structures it
+// references. Structures on a cycle, or above one, get no level.
+class Hierarchy
+{
+public:
+  Hierarchy(Library *library);
+
+  QStringList names() const;
+  QStringList children(const QString &name) const;
+  QStringList parents(const QString &name) const;
+  QStringList topStructures() const;
+  QList<QStringList> levels() const;
+  QStringList topologicalOrder() const;
+  bool hasCycle() const;
+  QStringList cyclic() const;
+
+  QHash<QString, QRectF> computeBounds(int workerCount) const;
+
+private:
+  void build(Library *library);
+  void sortLevels();
+  QStringList namesOf(const QList<int> &indices) const;
+
+  QStringList _names;
+  QHash<QString, int> _index;
+  QVector<StructureHeader> _headers;
+  QVector<QList<int> > _children;
+  QVector<QList<int> > _parents;
+  QList<QList<int> > _levels;
+  QList<int> _cyclic;
+};
+
+} // namespace Gds
+
+#endif // HIERARCHY_H
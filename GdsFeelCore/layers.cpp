@@ -34,18 +34,24 @@ void Layers::load(QFileInfo xmlStorageInfo)
   Q_ASSERT(xmlStorageInfo.exists());
   qDebug() << xmlStorageInfo.absoluteFilePath() << endl;
 
-  QDomDocument domDoc("layers");
   QFile xmlStorage(xmlStorageInfo.absoluteFilePath());
-  if (!xmlStorage.open(QIODevice::ReadOnly)) {
-    qDebug() << "Xml File can't open" << xmlStorageInfo.fileName();
+  load(&xmlStorage);
+}
+
+
+void Layers::load(QIODevice *xmlStorage)
+{
+  QDomDocument domDoc("layers");
+  if (!xmlStorage->open(QIODevice::ReadOnly)) {
+    qDebug() << "Xml can't open";
     return;
   }
-  if (!domDoc.setContent(&xmlStorage)) {
-    qDebug() << "Xml contents error" << xmlStorageInfo.fileName();
-    xmlStorage.close();
+  if (!domDoc.setContent(xmlStorage)) {
+    qDebug() << "Xml contents error";
+    xmlStorage->close();
     return;
   }
-  xmlStorage.close();
+  xmlStorage->close();
 
   QDomElement docElem = domDoc.documentElement();
   QDomNode n = docElem.firstChild();
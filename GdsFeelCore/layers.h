@@ -4,6 +4,8 @@
 #include <QMap>
 #include <QFileInfo>
 
+class QIODevice;
+
 namespace Gds {
 
 class Layer;
@@ -17,6 +19,7 @@ public:
   QList<int> numbers() const;
 
   void load(QFileInfo xmlStorageInfo);
+  void load(QIODevice *xmlStorage);
 
 private:
   QMap<int, Layer*> _layerMap;
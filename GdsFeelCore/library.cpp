@@ -1,466 +1,1086 @@
-#include <QtCore/QString>
-#include <QtCore/QFileInfo>
-#include <QtCore/QDir>
-#include <QtCore/QList>
-#include <QtCore/QDebug>
-#include <QtCore/QLibrary>
-#include <QtCore/QSettings>
-
-#include "qzipreader_p.h"
-#include "qzipwriter_p.h"
-
-#include "library.h"
-#include "structure.h"
-#include "layer.h"
-#include "layers.h"
-#include "config.h"
-
-
-namespace Gds {
-
-const QString LIBRARY_META_FILENAME = "LIB.ini";
-const QString LAYERS_FILENAME = "layers.xml";
-
-static void getSubTree(QDir& base, QFileInfoList &infos)
-{
-  QDir::Filters filters = QDir::AllEntries | QDir::NoDotAndDotDot;
-  QFileInfoList entries = base.entryInfoList(filters);
-  foreach (QFileInfo info , entries) {
-    infos.push_back(info);
-    if (info.isDir()) {
-      QDir newBase(info.filePath());
-      getSubTree(newBase, infos);
-    }
-  }
-}
-
-static void getZipMembers(QFileInfo& info,
-                          QStringList& names,
-                          QString findMember)
-{
-  QZipReader reader(info.absoluteFilePath(), QIODevice::ReadOnly);
-  if (reader.status() != QZipReader::NoError) {
-    qDebug() << "open error: " << info.absolutePath();
-  }
-
-  QList<QZipReader::FileInfo> list = reader.fileInfoList();
-  foreach (QZipReader::FileInfo info, list) {
-    names.push_back(info.filePath);
-    if (! findMember.isEmpty()) {
-      if (info.filePath == findMember) {
-        break;
-      }
-    }
-  }
-  reader.close();
-}
-
-
-static bool isValidTarget(QFileInfo info)
-{
-  QStringList members;
-  getZipMembers(info, members, LIBRARY_META_FILENAME);
-  return members.contains(LIBRARY_META_FILENAME);
-}
-
-//-----------------------------------------------------------------------------
-// private
-//-----------------------------------------------------------------------------
-
-class LibraryPrivate
-{
-public:
-  LibraryPrivate(const QString& dbPath, Library* library);
-  ~LibraryPrivate();
-
-  QString name() const;
-  QString nameWithExtension() const;
-
-  bool isOpen() const;
-  bool isClose() const;
-  QString pathToExtract() const;
-
-  void  tempBackup();
-  void  removeExtract();
-  void  loadLayers();
-  void  loadLibraryMeta();
-  void  lookupStructures(Library *library);
-  QStringList structureNames();
-  Structure *structureNamed(const QString structureName);
-  QColor colorForLayerNumber(int layerNumber);
-
-  static QString pathToExtractArea() ;
-
-  QString _dbName;
-  QString _unit;
-  int _dbu;
-  QFileInfo _dbFile;
-  Layers _layers;
-  Library *_library;
-
-  QMap<QString, Structure*> _structureMap;
-};
-
-
-LibraryPrivate::LibraryPrivate(const QString& dbPath, Library* library)
-{
-  _dbFile.setFile(dbPath);
-  _unit = QString("");
-  _dbu = 0;
-  _dbName = QString("");
-  _library = library;
-}
-
-
-LibraryPrivate::~LibraryPrivate()
-{
-  _structureMap.clear();
-}
-
-
-QString LibraryPrivate::nameWithExtension() const
-{
-  return _dbFile.fileName().toUpper();
-}
-
-
-QString LibraryPrivate::name() const
-{
-  return _dbFile.baseName().toUpper();
-}
-
-
-QString LibraryPrivate::pathToExtractArea()
-{
-  return QDir(
-    Config::pathToSmalltalkProject())
-      .absoluteFilePath(QString(".editlibs"));
-}
-
-
-QString LibraryPrivate::pathToExtract() const
-{
-  return QDir(
-    pathToExtractArea())
-      .absoluteFilePath(nameWithExtension());
-}
-
-
-void LibraryPrivate::tempBackup()
-{
-  QString backupPath = QDir::temp().absoluteFilePath(nameWithExtension());
-  if (QFile::exists(backupPath)) {
-    QFile::remove(backupPath);
-  }
-  QFile::copy(_dbFile.absoluteFilePath(), backupPath);
-}
-
-
-void LibraryPrivate::removeExtract()
-{
-  QString from(pathToExtract());
-  QDir fromDir(from);
-  QFileInfoList founds;
-
-  getSubTree(fromDir, founds);
-  foreach (QFileInfo info , founds) {
-    if (! info.isDir()) {
-      QFile::remove(info.absoluteFilePath());
-    }
-  }
-  foreach (QFileInfo info , founds) {
-    if (info.isDir()) {
-      QDir dir(info.absoluteFilePath());
-      dir.rmdir(info.absoluteFilePath());
-    }
-  }
-  fromDir.rmdir(from);
-}
-
-void LibraryPrivate::loadLayers()
-{
-  QDir dir(pathToExtract());
-  Q_ASSERT(dir.exists());
-  QString pathToLayers = dir.absoluteFilePath(LAYERS_FILENAME);
-  QFileInfo fInfo(pathToLayers);
-  if (! fInfo.exists()) return;
-  _layers.load(fInfo);
-}
-
-
-void LibraryPrivate::loadLibraryMeta()
-{
-  QDir dir(pathToExtract());
-  Q_ASSERT(dir.exists());
-  QString pathToMeta = dir.absoluteFilePath(LIBRARY_META_FILENAME);
-  // FIXME:
-  // if not found then call fixMetadata();
-  // Q_ASSERT(QFile::exists(pathToMeta));
-  if (!QFile::exists(pathToMeta)) {
-    _dbu = 1000;
-    _unit = "MM";
-    _dbName = name();
-    return;
-  }
-  QSettings meta(pathToMeta, QSettings::IniFormat);
-  meta.beginGroup("INITLIB");
-  _dbu = meta.value("dbu", 1000).toInt();
-  _unit = meta.value("unit", "MM").toString();
-  _dbName = meta.value("name", "").toString();
-  meta.endGroup();
-  Q_ASSERT(_dbName == name());
-}
-
-void LibraryPrivate::lookupStructures(Library *library)
-{
-  Q_ASSERT(isOpen());
-
-  QString from(pathToExtract());
-  QDir fromDir(from);
-  QFileInfoList founds;
-
-  getSubTree(fromDir, founds);
-  foreach (QFileInfo info, founds) {
-    if (info.isFile()) continue;
-    if (info.completeSuffix() != "structure") continue;
-    Structure *s = new Structure(info);
-    s->setParent(library);
-    _structureMap[s->name()] = s;
-  }
-}
-
-
-QStringList LibraryPrivate::structureNames()
-{
-  QStringList result;
-  foreach (Structure* s, _library->structures()) {
-    result.push_back(s->name());
-  }
-  return result;
-}
-
-
-QColor LibraryPrivate::colorForLayerNumber(int layerNumber)
-{
-  return _layers.atNumber(layerNumber)->color();
-}
-
-
-Structure *LibraryPrivate::structureNamed(const QString structureName)
-{
-  if (_structureMap.contains(structureName)) {
-    return _structureMap[structureName];
-  }
-  return 0;
-}
-
-
-bool  LibraryPrivate::isOpen() const
-{
-  QDir dir(pathToExtract());
-  return dir.exists();
-}
-
-bool  LibraryPrivate::isClose() const
-{
-  return ! isOpen();
-}
-
-
-//-----------------------------------------------------------------------------
-// class methods
-//-----------------------------------------------------------------------------
-
-QFileInfoList Library::files()
-{
-  QFileInfoList list;
-  QDir dir(Config::pathToSmalltalkProject());
-  qDebug() << dir.absolutePath();
-  QStringList filter("*.DB");
-  QFileInfoList all = dir.entryInfoList(filter);
-
-  foreach (QFileInfo info, all) {
-    if (isValidTarget(info)) {
-      list.append(info);
-    }
-  }
-  return list;
-}
-
-
-void Library::example()
-{
-  QList<Library*> libs = availables();
-
-  foreach (Library *lib, libs) {
-    lib->open();
-    lib->close();
-  }
-  while (!libs.isEmpty())
-    delete libs.takeFirst();
-}
-
-
-QList<Library*> Library::availables()
-{
-  QList<Library*> result;
-  QFileInfoList infos = files();
-
-  foreach (QFileInfo info, infos) {
-    result.append(new Library(info.absoluteFilePath()));
-  }
-  return result;
-}
-
-
-void Library::release(QList<Library*> & libs)
-{
-  while (! libs.isEmpty()) {
-    Library *lib = libs.takeFirst();
-    lib->close();
-    delete lib;
-  }
-}
-
-//-----------------------------------------------------------------------------
-// constructor & destructor
-//-----------------------------------------------------------------------------
-
-Library::Library(const QString& dbPath)
-{
-  p = new LibraryPrivate(dbPath, this);
-}
-
-Library::~Library()
-{
-  delete p;
-}
-
-
-//-----------------------------------------------------------------------------
-// instance methods
-//-----------------------------------------------------------------------------
-void Library::open()
-{
-  QString at(p->pathToExtract());
-  if (isOpen()) {
-    qDebug() << "already opend" << at;
-    return;
-  }
-  QZipReader reader(p->_dbFile.absoluteFilePath());
-  QDir dir(at);
-  if (! dir.mkpath(at)) {
-    qDebug() << "Fuck cant create path: " << at;
-  }
-  qDebug() << "Try extract to: " << at;
-  bool success = reader.extractAll(at);
-  reader.close();
-  Q_ASSERT(success);
-  p->loadLibraryMeta();
-  p->loadLayers();
-  Q_ASSERT(dir.exists());
-  p->lookupStructures(this);
-}
-
-
-void Library::close()
-{
-  QString from(p->pathToExtract());
-  if (isClose()) {
-    qDebug() << "already closed" << from;
-    return;
-  }
-  QDir fromDir(from);
-  QFileInfoList found;
-
-  getSubTree(fromDir, found);
-  QZipWriter writer(p->_dbFile.absoluteFilePath());
-  foreach (QFileInfo info , found) {
-    QString relativePath = fromDir.relativeFilePath(info.filePath());
-    if (info.isFile()) {
-      qDebug() << "FILE: " << relativePath;
-      QFile *ar = new QFile(info.absoluteFilePath());
-      writer.addFile(relativePath, ar);
-      delete ar;
-    }
-    else if (info.isDir()) {
-      qDebug() << "DIR: " << relativePath;
-      writer.addDirectory(relativePath);
-    }
-    qDebug() << info.absoluteFilePath();
-  }
-  writer.close();
-  p->removeExtract();
-  QDir dir(p->pathToExtract());
-  Q_ASSERT(! dir.exists());
-}
-
-int Library::dbu()
-{
-  return p->_dbu;
-}
-
-QString Library::unit()
-{
-  return p->_unit;
-}
-
-bool  Library::isOpen() const
-{
-  return p->isOpen();
-}
-
-bool  Library::isClose() const
-{
-  return p->isClose();
-}
-
-
-QString Library::nameWithExtension() const
-{
-  return p->nameWithExtension();
-}
-
-
-QString Library::name() const
-{
-  return p->name();
-}
-
-
-QList<Structure*> Library::structures()
-{
-  if (! isOpen()) {
-    open();
-  }
-  return this->findChildren<Structure *>();
-}
-
-
-QStringList Library::structureNames()
-{
-  if (! isOpen()) {
-    open();
-  }
-  return p->structureNames();
-}
-
-
-QColor Library::colorForLayerNumber(int layerNumber) const
-{
-  return p->colorForLayerNumber(layerNumber);
-}
-
-
-Structure *Library::structureNamed(const QString structureName)
-{
-  if (! isOpen()) {
-    open();
-  }
-  return p->structureNamed(structureName);
-}
-
-} // namespace Gds
-
-
-// vim: sw=2 ts=2 expandtab
+#include <QtCore/QString>
+#include <QtCore/QFileInfo>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QList>
+#include <QtCore/QDebug>
+#include <QtCore/QLibrary>
+#include <QtCore/QSettings>
+#include <QtCore/QBuffer>
+#include <QtCore/QThread>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QMutex>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtCore/QTemporaryFile>
+
+#include "qzipreader_p.h"
+#include "qzipwriter_p.h"
+
+#include "library.h"
+#include "structure.h"
+#include "element.h"
+#include "elementstore.h"
+#include "layer.h"
+#include "layers.h"
+#include "config.h"
+#include "catalog.h"
+#include "hierarchy.h"
+#include "geometrycache.h"
+
+
+namespace Gds {
+
+const QString LAYERS_FILENAME = "layers.xml";
+const QString SUMMARY_GROUP = "SUMMARY";
+const int SUMMARY_VERSION = 1;
+
+static void getSubTree(QDir& base, QFileInfoList &infos)
+{
+  QDir::Filters filters = QDir::AllEntries | QDir::NoDotAndDotDot;
+  QFileInfoList entries = base.entryInfoList(filters);
+  foreach (QFileInfo info , entries) {
+    infos.push_back(info);
+    if (info.isDir()) {
+      QDir newBase(info.filePath());
+      getSubTree(newBase, infos);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+// private
+//-----------------------------------------------------------------------------
+
+struct PreloadResult
+{
+  Structure *structure;
+  ElementStore store;
+  bool parsed;
+};
+
+
+class LibraryPrivate
+{
+public:
+  LibraryPrivate(const QString& dbPath, Library* library);
+  ~LibraryPrivate();
+
+  QString name() const;
+  QString nameWithExtension() const;
+
+  bool isOpen() const;
+  bool isClose() const;
+  bool isMounted() const;
+  QString pathToExtract() const;
+
+  void  tempBackup();
+  void  removeExtract();
+  bool  collectModified(QZipReader &reader, const QDir &fromDir,
+                        const QFileInfoList &found, QSet<QString> &modified);
+  bool  hasModifiedMembers();
+  bool  save();
+  void  unmount();
+  void  loadLayers();
+  void  loadLibraryMeta();
+  void  useLibraryMeta(const CatalogEntry *meta);
+  void  readSummaries(QSettings &meta);
+  void  useSummaries();
+  void  storeSummaries();
+  QSet<QString> staleSummaries();
+  void  lookupStructures(Library *library);
+  void  lookupMountedStructures(Library *library);
+  void  addStructures(Library *library, const QMap<QString, QList<int> > &generations);
+  void  releaseStructures();
+  QByteArray memberData(const QString &memberPath);
+  QStringList structureNames();
+  Structure *structureNamed(const QString structureName);
+  QColor colorForLayerNumber(int layerNumber);
+
+  static QString pathToExtractArea() ;
+
+  QString _dbName;
+  QString _unit;
+  int _dbu;
+  QFileInfo _dbFile;
+  Layers _layers;
+  Library *_library;
+  QZipReader *_reader;
+  QMutex _readerMutex;
+  QSet<QString> _written;
+
+  QThreadPool _preloadPool;
+  QAtomicInt _preloadCanceled;
+  QMutex _preloadMutex;
+  QList<PreloadResult> _preloaded;
+  int _preloadTotal;
+  int _preloadDone;
+
+  QMap<QString, Structure*> _structureMap;
+  QList<Structure*> _structures;
+  QHash<QString, StructureSummary> _summaries;
+  GeometryCache _geometryCache;
+};
+
+
+LibraryPrivate::LibraryPrivate(const QString& dbPath, Library* library)
+{
+  _dbFile.setFile(dbPath);
+  _unit = QString("");
+  _dbu = 0;
+  _dbName = QString("");
+  _library = library;
+  _reader = 0;
+  _preloadTotal = 0;
+  _preloadDone = 0;
+}
+
+
+LibraryPrivate::~LibraryPrivate()
+{
+  _preloadCanceled.store(1);
+  _preloadPool.waitForDone();
+  _preloaded.clear();
+  _structureMap.clear();
+  delete _reader;
+}
+
+
+QString LibraryPrivate::nameWithExtension() const
+{
+  return _dbFile.fileName().toUpper();
+}
+
+
+QString LibraryPrivate::name() const
+{
+  return _dbFile.baseName().toUpper();
+}
+
+
+QString LibraryPrivate::pathToExtractArea()
+{
+  return QDir(
+    Config::pathToSmalltalkProject())
+      .absoluteFilePath(QString(".editlibs"));
+}
+
+
+QString LibraryPrivate::pathToExtract() const
+{
+  return QDir(
+    pathToExtractArea())
+      .absoluteFilePath(nameWithExtension());
+}
+
+
+void LibraryPrivate::tempBackup()
+{
+  QString backupPath = QDir::temp().absoluteFilePath(nameWithExtension());
+  if (QFile::exists(backupPath)) {
+    QFile::remove(backupPath);
+  }
+  QFile::copy(_dbFile.absoluteFilePath(), backupPath);
+}
+
+
+void LibraryPrivate::removeExtract()
+{
+  QString from(pathToExtract());
+  QDir fromDir(from);
+  QFileInfoList founds;
+
+  getSubTree(fromDir, founds);
+  foreach (QFileInfo info , founds) {
+    if (! info.isDir()) {
+      QFile::remove(info.absoluteFilePath());
+    }
+  }
+  foreach (QFileInfo info , founds) {
+    if (info.isDir()) {
+      QDir dir(info.absoluteFilePath());
+      dir.rmdir(info.absoluteFilePath());
+    }
+  }
+  fromDir.rmdir(from);
+}
+
+// Collects the files that have to be compressed again: those written
+// since extraction through Structure::store() or by the library, see
+// Library::memberWritten(), and files the archive does not have. All
+// other files are copied from the archive as they are. Returns true if
+// anything has to be saved, including files that were removed.
+bool LibraryPrivate::collectModified(QZipReader &reader, const QDir &fromDir,
+                                     const QFileInfoList &found,
+                                     QSet<QString> &modified)
+{
+  QSet<QString> archived;
+  foreach (QZipReader::FileInfo entry, reader.fileInfoList()) {
+    if (! entry.isDir && ! entry.filePath.endsWith("/")) {
+      archived.insert(entry.filePath);
+    }
+  }
+  bool changed = false;
+  foreach (QFileInfo info, found) {
+    if (! info.isFile()) continue;
+    QString relativePath = fromDir.relativeFilePath(info.filePath());
+    bool inArchive = archived.remove(relativePath);
+    if (! inArchive || _written.contains(relativePath)) {
+      modified.insert(relativePath);
+      changed = true;
+    }
+  }
+  return changed || ! archived.isEmpty();
+}
+
+
+bool LibraryPrivate::hasModifiedMembers()
+{
+  QDir fromDir(pathToExtract());
+  QFileInfoList found;
+  getSubTree(fromDir, found);
+  QZipReader reader(_dbFile.absoluteFilePath());
+  QSet<QString> modified;
+  return collectModified(reader, fromDir, found, modified);
+}
+
+
+// Rewrites the archive from the extract area. Unmodified members are
+// copied as stored bytes from the old archive; only modified or new
+// files are compressed again. Nothing is written if nothing changed.
+bool LibraryPrivate::save()
+{
+  QDir fromDir(pathToExtract());
+  QFileInfoList found;
+  getSubTree(fromDir, found);
+
+  QZipReader reader(_dbFile.absoluteFilePath());
+  QSet<QString> modified;
+  if (! collectModified(reader, fromDir, found, modified)) {
+    qDebug() << "not modified" << nameWithExtension();
+    return true;
+  }
+  storeSummaries();
+  modified.insert(LIBRARY_META_FILENAME);
+  found.clear();
+  getSubTree(fromDir, found);
+
+  QString dbPath = _dbFile.absoluteFilePath();
+  QString savingPath = dbPath + ".saving";
+  QZipWriter writer(savingPath);
+  writer.setWorkerCount(QThread::idealThreadCount());
+  foreach (QFileInfo info , found) {
+    if (writer.status() != QZipWriter::NoError) {
+      break;
+    }
+    QString relativePath = fromDir.relativeFilePath(info.filePath());
+    if (info.isFile()) {
+      if (modified.contains(relativePath)
+          || ! writer.copyEntry(reader, relativePath)) {
+        qDebug() << "FILE: " << relativePath;
+        QFile ar(info.absoluteFilePath());
+        writer.addFile(relativePath, &ar);
+      }
+    }
+    else if (info.isDir()) {
+      qDebug() << "DIR: " << relativePath;
+      writer.addDirectory(relativePath);
+    }
+  }
+  writer.close();
+  reader.close();
+  if (writer.status() != QZipWriter::NoError) {
+    qDebug() << "can't write: " << savingPath;
+    QFile::remove(savingPath);
+    return false;
+  }
+
+  // the old archive is only deleted once the new one is in its place
+  QString backupPath = dbPath + ".backup";
+  QFile::remove(backupPath);
+  if (QFile::exists(dbPath) && ! QFile::rename(dbPath, backupPath)) {
+    qDebug() << "can't move aside: " << dbPath;
+    QFile::remove(savingPath);
+    return false;
+  }
+  if (! QFile::rename(savingPath, dbPath)) {
+    qDebug() << "can't replace: " << dbPath;
+    QFile::rename(backupPath, dbPath);
+    QFile::remove(savingPath);
+    return false;
+  }
+  QFile::remove(backupPath);
+  return true;
+}
+
+
+void LibraryPrivate::unmount()
+{
+  releaseStructures();
+  _reader->close();
+  delete _reader;
+  _reader = 0;
+}
+
+
+QByteArray LibraryPrivate::memberData(const QString &memberPath)
+{
+  if (isMounted()) {
+    // a mapped archive is read without shared state, so only the index
+    // scan is serialized and workers inflate members concurrently
+    QMutexLocker locker(&_readerMutex);
+    if (_reader->isMapped()) {
+      locker.unlock();
+    }
+    return _reader->fileData(memberPath);
+  }
+  QFile member(QDir(pathToExtract()).absoluteFilePath(memberPath));
+  if (! member.open(QIODevice::ReadOnly)) {
+    return QByteArray();
+  }
+  return member.readAll();
+}
+
+
+void LibraryPrivate::loadLayers()
+{
+  if (isMounted()) {
+    QByteArray contents = _reader->fileDataView(LAYERS_FILENAME);
+    if (contents.isEmpty()) return;
+    QBuffer buffer(&contents);
+    _layers.load(&buffer);
+    return;
+  }
+  QDir dir(pathToExtract());
+  Q_ASSERT(dir.exists());
+  QString pathToLayers = dir.absoluteFilePath(LAYERS_FILENAME);
+  QFileInfo fInfo(pathToLayers);
+  if (! fInfo.exists()) return;
+  _layers.load(fInfo);
+}
+
+
+void LibraryPrivate::loadLibraryMeta()
+{
+  QString pathToMeta;
+  QTemporaryFile spool;
+  if (isMounted()) {
+    QByteArray contents = _reader->fileDataView(LIBRARY_META_FILENAME);
+    if (! Catalog::spoolMeta(contents, spool)) {
+      useLibraryMeta(0);
+      return;
+    }
+    pathToMeta = spool.fileName();
+  }
+  else {
+    QDir dir(pathToExtract());
+    Q_ASSERT(dir.exists());
+    pathToMeta = dir.absoluteFilePath(LIBRARY_META_FILENAME);
+    // FIXME:
+    // if not found then call fixMetadata();
+    // Q_ASSERT(QFile::exists(pathToMeta));
+    if (!QFile::exists(pathToMeta)) {
+      useLibraryMeta(0);
+      return;
+    }
+  }
+  CatalogEntry meta;
+  Catalog::readMeta(pathToMeta, meta);
+  useLibraryMeta(&meta);
+  QSettings settings(pathToMeta, QSettings::IniFormat);
+  readSummaries(settings);
+}
+
+
+void LibraryPrivate::useLibraryMeta(const CatalogEntry *meta)
+{
+  if (meta == 0) {
+    _dbu = 1000;
+    _unit = "MM";
+    _dbName = name();
+    return;
+  }
+  _dbu = meta->dbu;
+  _unit = meta->unit;
+  _dbName = meta->name;
+  Q_ASSERT(_dbName == name());
+}
+
+static QString rectToString(const QRectF &rect)
+{
+  qreal x1, y1, x2, y2;
+  rect.getCoords(&x1, &y1, &x2, &y2);
+  return QString("%1 %2 %3 %4").arg(x1, 0, 'g', 17).arg(y1, 0, 'g', 17)
+      .arg(x2, 0, 'g', 17).arg(y2, 0, 'g', 17);
+}
+
+
+static bool rectFromString(const QString &text, QRectF &rect)
+{
+  QStringList items = text.split(" ", QString::SkipEmptyParts);
+  if (items.size() != 4) return false;
+  rect.setCoords(items.at(0).toDouble(), items.at(1).toDouble(),
+                 items.at(2).toDouble(), items.at(3).toDouble());
+  return true;
+}
+
+
+void LibraryPrivate::readSummaries(QSettings &meta)
+{
+  _summaries.clear();
+  meta.beginGroup(SUMMARY_GROUP);
+  if (meta.value("version", 0).toInt() != SUMMARY_VERSION) {
+    meta.endGroup();
+    return;
+  }
+  foreach (QString structureName, meta.childGroups()) {
+    meta.beginGroup(structureName);
+    StructureSummary summary;
+    summary.generation = meta.value("generation", -1).toInt();
+    summary.elementCount = meta.value("elements", 0).toInt();
+    summary.vertexCount = meta.value("vertices", 0).toInt();
+    foreach (QString layer, meta.value("layers").toString().split(" ", QString::SkipEmptyParts)) {
+      summary.layers.append(layer.toInt());
+    }
+    summary.references = meta.value("references").toString().split(" ", QString::SkipEmptyParts);
+    if (rectFromString(meta.value("bounds").toString(), summary.bounds)) {
+      _summaries.insert(structureName, summary);
+    }
+    meta.endGroup();
+  }
+  meta.endGroup();
+}
+
+
+// Bounds in a summary include every referenced structure, so the
+// summaries are only used when all of them match the current
+// generations. Otherwise each structure computes its own again. The
+// records are kept for storeSummaries() either way.
+void LibraryPrivate::useSummaries()
+{
+  bool complete = _summaries.size() == _structureMap.size();
+  foreach (Structure *s, _structureMap) {
+    if (! complete) break;
+    complete = _summaries.value(s->name()).generation == s->generation();
+  }
+  if (complete) {
+    foreach (Structure *s, _structureMap) {
+      s->setSummary(_summaries.value(s->name()));
+    }
+  }
+}
+
+
+// Names of the structures whose stored summary is out of date: those
+// with a new generation or without a record, and everything that
+// references them, directly or not. Parents are found through the
+// stored references, so only changed structures read their header.
+QSet<QString> LibraryPrivate::staleSummaries()
+{
+  QSet<QString> stale;
+  QHash<QString, QStringList> parents;
+  foreach (Structure *s, _structureMap) {
+    QStringList references;
+    if (_summaries.value(s->name()).generation == s->generation()) {
+      references = _summaries.value(s->name()).references;
+    }
+    else {
+      stale.insert(s->name());
+      references = s->header().referenceNames();
+    }
+    foreach (QString child, references) {
+      parents[child].append(s->name());
+    }
+  }
+  // a removed structure changes its parents too
+  foreach (QString name, _summaries.keys()) {
+    if (! _structureMap.contains(name)) {
+      stale.insert(name);
+    }
+  }
+  QList<QString> queue = stale.toList();
+  while (! queue.isEmpty()) {
+    foreach (QString parent, parents.value(queue.takeFirst())) {
+      if (! stale.contains(parent)) {
+        stale.insert(parent);
+        queue.append(parent);
+      }
+    }
+  }
+  return stale;
+}
+
+
+// Writes a summary of every structure into the extracted LIB.ini. Only
+// stale summaries are computed again, see staleSummaries(); the others
+// are written back as they were read, and also give their bounds to the
+// stale structures that reference them.
+void LibraryPrivate::storeSummaries()
+{
+  QSet<QString> stale = staleSummaries();
+  foreach (Structure *s, _structureMap) {
+    if (stale.contains(s->name())) {
+      s->resetDataBounds();
+    }
+    else {
+      s->setSummary(_summaries.value(s->name()));
+    }
+  }
+  QHash<QString, StructureSummary> summaries;
+  foreach (Structure *s, _structureMap) {
+    summaries.insert(s->name(), s->summary());
+  }
+  _summaries = summaries;
+
+  QSettings meta(QDir(pathToExtract()).absoluteFilePath(LIBRARY_META_FILENAME),
+                 QSettings::IniFormat);
+  if (! meta.contains("INITLIB/name")) {
+    meta.setValue("INITLIB/dbu", _dbu);
+    meta.setValue("INITLIB/unit", _unit);
+    meta.setValue("INITLIB/name", _dbName);
+  }
+  meta.remove(SUMMARY_GROUP);
+  meta.beginGroup(SUMMARY_GROUP);
+  meta.setValue("version", SUMMARY_VERSION);
+  foreach (Structure *s, _structureMap) {
+    StructureSummary summary = _summaries.value(s->name());
+    QStringList layers;
+    foreach (int layer, summary.layers) {
+      layers.append(QString::number(layer));
+    }
+    meta.beginGroup(s->name());
+    meta.setValue("generation", summary.generation);
+    meta.setValue("bounds", rectToString(summary.bounds));
+    meta.setValue("elements", summary.elementCount);
+    meta.setValue("vertices", summary.vertexCount);
+    meta.setValue("layers", layers.join(" "));
+    meta.setValue("references", summary.references.join(" "));
+    meta.endGroup();
+  }
+  meta.endGroup();
+  meta.sync();
+}
+
+
+// Files "NAME.structure/NAME.<gen>.gdsfeelbeta" are grouped by their
+// structure directory, so every generation list comes out of one pass.
+static void collectGeneration(const QString &relativePath, bool isFile,
+                              QMap<QString, QList<int> > &generations)
+{
+  QStringList items = relativePath.split("/", QString::SkipEmptyParts);
+  if (items.isEmpty()) return;
+  QString dirName = items.first();
+  if (QFileInfo(dirName).completeSuffix() != "structure") return;
+  QList<int> &numbers = generations[dirName];
+  if (items.size() != 2 || ! isFile) return;
+  int num = Structure::generationNumberOf(items.at(1));
+  if (num >= 0)
+    numbers.push_back(num);
+}
+
+
+void LibraryPrivate::lookupStructures(Library *library)
+{
+  Q_ASSERT(isOpen());
+  if (isMounted()) {
+    lookupMountedStructures(library);
+    return;
+  }
+
+  QDir root(pathToExtract());
+  QMap<QString, QList<int> > generations;
+  QDirIterator iter(root.absolutePath(), QDir::AllEntries | QDir::NoDotAndDotDot,
+                    QDirIterator::Subdirectories);
+  while (iter.hasNext()) {
+    iter.next();
+    collectGeneration(root.relativeFilePath(iter.filePath()),
+                      iter.fileInfo().isFile(), generations);
+  }
+  addStructures(library, generations);
+}
+
+
+void LibraryPrivate::lookupMountedStructures(Library *library)
+{
+  QMap<QString, QList<int> > generations;
+  foreach (QZipReader::FileInfo info, _reader->fileInfoList()) {
+    collectGeneration(info.filePath, info.isFile, generations);
+  }
+  addStructures(library, generations);
+}
+
+
+void LibraryPrivate::addStructures(Library *library,
+                                   const QMap<QString, QList<int> > &generations)
+{
+  QDir root(pathToExtract());
+  QMapIterator<QString, QList<int> > iter(generations);
+  while (iter.hasNext()) {
+    iter.next();
+    QList<int> numbers = iter.value();
+    qSort(numbers);
+    Structure *s = new Structure(QFileInfo(root.absoluteFilePath(iter.key())),
+                                 numbers);
+    s->setParent(library);
+    _structureMap[s->name()] = s;
+  }
+  _structures = _structureMap.values();
+}
+
+
+void LibraryPrivate::releaseStructures()
+{
+  _geometryCache.clear();
+  qDeleteAll(_structureMap);
+  _structureMap.clear();
+  _structures.clear();
+}
+
+
+QStringList LibraryPrivate::structureNames()
+{
+  return _structureMap.keys();
+}
+
+
+QColor LibraryPrivate::colorForLayerNumber(int layerNumber)
+{
+  return _layers.atNumber(layerNumber)->color();
+}
+
+
+Structure *LibraryPrivate::structureNamed(const QString structureName)
+{
+  if (_structureMap.contains(structureName)) {
+    return _structureMap[structureName];
+  }
+  return 0;
+}
+
+
+bool  LibraryPrivate::isOpen() const
+{
+  if (isMounted()) {
+    return true;
+  }
+  QDir dir(pathToExtract());
+  return dir.exists();
+}
+
+bool  LibraryPrivate::isMounted() const
+{
+  return _reader != 0;
+}
+
+bool  LibraryPrivate::isClose() const
+{
+  return ! isOpen();
+}
+
+
+// Parses one structure on the preload pool and queues its store for
+// Library::adoptPreloaded(), which runs on the library's thread.
+class StructurePreloadTask : public QRunnable
+{
+public:
+  StructurePreloadTask(LibraryPrivate *owner, Structure *structure)
+    : _owner(owner), _structure(structure) {}
+
+  void run()
+  {
+    PreloadResult result;
+    result.structure = _structure;
+    result.parsed = ! _owner->_preloadCanceled.load();
+    if (result.parsed) {
+      _structure->readStore(result.store);
+    }
+    {
+      QMutexLocker locker(&_owner->_preloadMutex);
+      _owner->_preloaded.append(result);
+    }
+    QMetaObject::invokeMethod(_owner->_library, "adoptPreloaded", Qt::QueuedConnection);
+  }
+
+private:
+  LibraryPrivate *_owner;
+  Structure *_structure;
+};
+
+
+//-----------------------------------------------------------------------------
+// class methods
+//-----------------------------------------------------------------------------
+
+QFileInfoList Library::candidateFiles()
+{
+  QDir dir(Config::pathToSmalltalkProject());
+  qDebug() << dir.absolutePath();
+  QStringList filter("*.DB");
+  return dir.entryInfoList(filter);
+}
+
+
+QFileInfoList Library::files()
+{
+  QFileInfoList list;
+  Catalog catalog;
+  foreach (QFileInfo info, candidateFiles()) {
+    if (catalog.entryFor(info).valid) {
+      list.append(info);
+    }
+  }
+  catalog.prune();
+  catalog.sync();
+  return list;
+}
+
+
+void Library::example()
+{
+  QList<Library*> libs = availables();
+
+  foreach (Library *lib, libs) {
+    lib->open();
+    lib->close();
+  }
+  while (!libs.isEmpty())
+    delete libs.takeFirst();
+}
+
+
+QList<Library*> Library::availables()
+{
+  QList<Library*> result;
+  QFileInfoList infos = files();
+
+  foreach (QFileInfo info, infos) {
+    result.append(new Library(info.absoluteFilePath()));
+  }
+  return result;
+}
+
+
+void Library::release(QList<Library*> & libs)
+{
+  while (! libs.isEmpty()) {
+    Library *lib = libs.takeFirst();
+    lib->close();
+    delete lib;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// constructor & destructor
+//-----------------------------------------------------------------------------
+
+Library::Library(const QString& dbPath)
+{
+  p = new LibraryPrivate(dbPath, this);
+}
+
+Library::~Library()
+{
+  delete p;
+}
+
+
+//-----------------------------------------------------------------------------
+// instance methods
+//-----------------------------------------------------------------------------
+
+// Starts parsing every structure that is not loaded yet on a thread
+// pool. Progress is reported through preloadProgress(), and
+// preloadFinished() is emitted once all of them are adopted.
+void Library::preload()
+{
+  if (isClose() || isPreloading()) {
+    return;
+  }
+  QList<Structure*> pending;
+  foreach (Structure *s, structures()) {
+    if (! s->isLoaded()) {
+      pending.append(s);
+    }
+  }
+  p->_preloadCanceled.store(0);
+  p->_preloadDone = 0;
+  p->_preloadTotal = pending.size();
+  if (pending.isEmpty()) {
+    emit preloadFinished(false);
+    return;
+  }
+  foreach (Structure *s, pending) {
+    p->_preloadPool.start(new StructurePreloadTask(p, s));
+  }
+}
+
+
+// Structures not started yet are skipped; the ones already parsed are
+// still adopted.
+void Library::cancelPreload()
+{
+  p->_preloadCanceled.store(1);
+}
+
+
+// Blocks until the preload pool is idle and adopts its results, for
+// callers that do not run an event loop.
+void Library::waitForPreload()
+{
+  p->_preloadPool.waitForDone();
+  adoptPreloaded();
+}
+
+
+// Computes the bounds of every structure in one bottom-up pass over the
+// hierarchy, instead of recursing from each structure on demand.
+void Library::updateDataBounds()
+{
+  Hierarchy hierarchy(this);
+  QHash<QString, QRectF> bounds = hierarchy.computeBounds(QThread::idealThreadCount());
+  QHashIterator<QString, QRectF> iter(bounds);
+  while (iter.hasNext()) {
+    iter.next();
+    structureNamed(iter.key())->setDataBounds(iter.value());
+  }
+}
+
+
+bool Library::isPreloading() const
+{
+  return p->_preloadTotal > 0;
+}
+
+
+void Library::adoptPreloaded()
+{
+  QList<PreloadResult> ready;
+  {
+    QMutexLocker locker(&p->_preloadMutex);
+    ready.swap(p->_preloaded);
+  }
+  if (ready.isEmpty()) {
+    return;
+  }
+  foreach (const PreloadResult &result, ready) {
+    if (result.parsed) {
+      result.structure->adoptStore(result.store);
+    }
+    p->_preloadDone++;
+    emit preloadProgress(p->_preloadDone, p->_preloadTotal);
+  }
+  if (p->_preloadDone >= p->_preloadTotal) {
+    p->_preloadTotal = 0;
+    emit preloadFinished(p->_preloadCanceled.load() != 0);
+  }
+}
+
+void Library::open()
+{
+  QString at(p->pathToExtract());
+  if (isOpen()) {
+    qDebug() << "already opend" << at;
+    return;
+  }
+  QZipReader reader(p->_dbFile.absoluteFilePath());
+  QDir dir(at);
+  if (! dir.mkpath(at)) {
+    qDebug() << "Fuck cant create path: " << at;
+  }
+  qDebug() << "Try extract to: " << at;
+  bool success = reader.extractAll(at, QThread::idealThreadCount());
+  reader.close();
+  Q_ASSERT(success);
+  p->_written.clear();
+  p->loadLibraryMeta();
+  p->loadLayers();
+  Q_ASSERT(dir.exists());
+  p->lookupStructures(this);
+  p->useSummaries();
+}
+
+
+// Read-only alternative to open(): the archive stays packed and members
+// are inflated only when a structure is actually loaded.
+void Library::mount()
+{
+  if (isOpen()) {
+    qDebug() << "already opend" << p->pathToExtract();
+    return;
+  }
+  QZipReader *reader = new QZipReader(p->_dbFile.absoluteFilePath());
+  if (reader->status() != QZipReader::NoError) {
+    qDebug() << "mount error: " << p->_dbFile.absoluteFilePath();
+    delete reader;
+    return;
+  }
+  p->_reader = reader;
+  p->loadLibraryMeta();
+  p->loadLayers();
+  p->lookupStructures(this);
+  p->useSummaries();
+}
+
+
+void Library::close()
+{
+  QString from(p->pathToExtract());
+  if (isClose()) {
+    qDebug() << "already closed" << from;
+    return;
+  }
+  cancelPreload();
+  waitForPreload();
+  if (isMounted()) {
+    p->unmount();
+    return;
+  }
+  foreach (Structure *s, p->_structureMap) {
+    if (s->isDirty()) {
+      s->store();
+    }
+  }
+  if (! p->save()) {
+    qDebug() << "save failed, keep extract: " << from;
+    return;
+  }
+  p->removeExtract();
+  p->_written.clear();
+  QDir dir(p->pathToExtract());
+  Q_ASSERT(! dir.exists());
+}
+
+int Library::dbu()
+{
+  if (! isOpen()) {
+    return Catalog().entryFor(p->_dbFile).dbu;
+  }
+  return p->_dbu;
+}
+
+QString Library::unit()
+{
+  if (! isOpen()) {
+    return Catalog().entryFor(p->_dbFile).unit;
+  }
+  return p->_unit;
+}
+
+bool  Library::isOpen() const
+{
+  return p->isOpen();
+}
+
+bool  Library::isClose() const
+{
+  return p->isClose();
+}
+
+bool  Library::isMounted() const
+{
+  return p->isMounted();
+}
+
+
+bool  Library::isDirty()
+{
+  if (isClose() || isMounted()) {
+    return false;
+  }
+  foreach (Structure *s, p->_structureMap) {
+    if (s->isDirty()) return true;
+  }
+  return p->hasModifiedMembers();
+}
+
+
+GeometryCache *Library::geometryCache()
+{
+  return &p->_geometryCache;
+}
+
+
+QByteArray Library::memberData(const QString &memberPath)
+{
+  return p->memberData(memberPath);
+}
+
+
+// Records that memberPath was written into the extract area, so that
+// saving compresses it again; every other member is copied from the
+// archive as it is.
+void Library::memberWritten(const QString &memberPath)
+{
+  p->_written.insert(memberPath);
+}
+
+
+// Answers the crc32 recorded in the central directory, so a mounted
+// member can be identified without inflating it.
+bool Library::memberCrc(const QString &memberPath, quint32 &crc)
+{
+  if (! isMounted()) {
+    return false;
+  }
+  QMutexLocker locker(&p->_readerMutex);
+  QZipReader::FileInfo info = p->_reader->entryInfo(memberPath);
+  if (info.filePath.isEmpty()) {
+    return false;
+  }
+  crc = info.crc32;
+  return true;
+}
+
+
+QString Library::nameWithExtension() const
+{
+  return p->nameWithExtension();
+}
+
+
+QString Library::name() const
+{
+  return p->name();
+}
+
+
+// Structures ordered by name, as kept by the library.
+const QList<Structure*> &Library::structures()
+{
+  if (! isOpen()) {
+    open();
+  }
+  return p->_structures;
+}
+
+
+// A closed library answers the names recorded in the catalog, without
+// extracting or mounting the archive.
+QStringList Library::structureNames()
+{
+  if (! isOpen()) {
+    return Catalog().entryFor(p->_dbFile).structureNames;
+  }
+  return p->structureNames();
+}
+
+
+QColor Library::colorForLayerNumber(int layerNumber) const
+{
+  return p->colorForLayerNumber(layerNumber);
+}
+
+
+Structure *Library::structureNamed(const QString structureName)
+{
+  if (! isOpen()) {
+    open();
+  }
+  return p->structureNamed(structureName);
+}
+
+} // namespace Gds
+
+
+// vim: sw=2 ts=2 expandtab
@@ -1,52 +1,74 @@
-#ifndef LIBRARY_H
-#define LIBRARY_H
-
-#include <QtCore/QList>
-#include <QtCore/QFileInfo>
-#include <QColor>
-
-namespace Gds {
-
-class Structure;
-class Layers;
-class LibraryPrivate;
-
-class Library : public QObject
-{
-  Q_OBJECT
-
-public:
-  Library(const QString& dbPath);
-  ~Library();
-
-  QString name() const;
-  QString nameWithExtension() const;
-  int dbu();
-  QString unit();
-
-  void open();
-  void close();
-
-  bool isOpen() const;
-  bool isClose() const;
-
-  Structure* structureNamed(const QString  name);
-  QList<Structure*> structures();
-  QStringList structureNames();
-  QColor colorForLayerNumber(int layerNumber) const;
-
-  static QFileInfoList files();
-  static QList<Library*> availables();
-  static void example();
-  static void release(QList<Library*> & libs);
-
-private:
-  LibraryPrivate  *p;
-
-};
-
-} // namespace Gds
-
-#endif // LIBRARY_H
-
-// vim : sw=2 ts=2 expandtab
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <QtCore/QList>
+#include <QtCore/QFileInfo>
+#include <QColor>
+
+namespace Gds {
+
+class Structure;
+class Layers;
+class GeometryCache;
+class LibraryPrivate;
+
+class Library : public QObject
+{
+  Q_OBJECT
+
+public:
+  Library(const QString& dbPath);
+  ~Library();
+
+  QString name() const;
+  QString nameWithExtension() const;
+  int dbu();
+  QString unit();
+
+  void open();
+  void mount();
+  void close();
+  void preload();
+  void cancelPreload();
+  void waitForPreload();
+  void updateDataBounds();
+
+  bool isOpen() const;
+  bool isClose() const;
+  bool isMounted() const;
+  bool isDirty();
+  bool isPreloading() const;
+
+  GeometryCache *geometryCache();
+  QByteArray memberData(const QString &memberPath);
+  bool memberCrc(const QString &memberPath, quint32 &crc);
+  void memberWritten(const QString &memberPath);
+
+  Structure* structureNamed(const QString  name);
+  const QList<Structure*> &structures();
+  QStringList structureNames();
+  QColor colorForLayerNumber(int layerNumber) const;
+
+  static QFileInfoList candidateFiles();
+  static QFileInfoList files();
+  static QList<Library*> availables();
+  static void example();
+  static void release(QList<Library*> & libs);
+
+signals:
+  void preloadProgress(int done, int total);
+  void preloadFinished(bool canceled);
+
+private slots:
+  void adoptPreloaded();
+
+private:
+  LibraryPrivate  *p;
+
+};
+
+} // namespace Gds
+
+#endif // LIBRARY_H
+
+// vim : sw=2 ts=2 expandtab
@@ -0,0 +1,28 @@
+#include <QtCore/QFileInfo>
+
+#include "libraryscanner.h"
+#include "library.h"
+#include "catalog.h"
+
+namespace Gds {
+
+LibraryScanner::LibraryScanner(QObject *parent)
+  : QThread(parent)
+{
+}
+
+
+void LibraryScanner::run()
+{
+  Catalog catalog;
+  foreach (QFileInfo info, Library::candidateFiles()) {
+    if (isInterruptionRequested()) break;
+    if (catalog.entryFor(info).valid) {
+      emit libraryFound(info.absoluteFilePath());
+    }
+  }
+  catalog.prune();
+  catalog.sync();
+}
+
+} // namespace Gds
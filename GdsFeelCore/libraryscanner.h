@@ -0,0 +1,26 @@
+#ifndef LIBRARYSCANNER_H
+#define LIBRARYSCANNER_H
+
+#include <QtCore/QThread>
+
+namespace Gds {
+
+// Looks for valid libraries of the project on its own thread and reports
+// each one as soon as it is validated. Stop it with requestInterruption().
+class LibraryScanner : public QThread
+{
+  Q_OBJECT
+
+public:
+  LibraryScanner(QObject *parent = 0);
+
+signals:
+  void libraryFound(const QString &dbPath);
+
+protected:
+  void run();
+};
+
+} // namespace Gds
+
+#endif // LIBRARYSCANNER_H
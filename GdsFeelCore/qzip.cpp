@@ -50,8 +50,17 @@
 #include <qendian.h>
 #include <qdebug.h>
 #include <qdir.h>
+#include <qhash.h>
+#include <qpair.h>
+#include <qbuffer.h>
+#include <qatomic.h>
+#include <qrunnable.h>
+#include <qthreadpool.h>
+#include <qmutex.h>
+#include <qwaitcondition.h>
 
 #include <zlib.h>
+#include <limits.h>
 #include <sys/stat.h>
 
 #if defined(Q_OS_WIN)
@@ -90,6 +99,11 @@ static inline ushort readUShort(const uchar *data)
     return (data[0]) + (data[1]<<8);
 }
 
+static inline quint64 readULongLong(const uchar *data)
+{
+    return quint64(readUInt(data)) | (quint64(readUInt(data + 4)) << 32);
+}
+
 static inline void writeUInt(uchar *data, uint i)
 {
     data[0] = i & 0xff;
@@ -104,6 +118,12 @@ static inline void writeUShort(uchar *data, ushort i)
     data[1] = (i>>8) & 0xff;
 }
 
+static inline void writeULongLong(uchar *data, quint64 i)
+{
+    writeUInt(data, uint(i & 0xffffffff));
+    writeUInt(data + 4, uint(i >> 32));
+}
+
 static inline void copyUInt(uchar *dest, const uchar *src)
 {
     dest[0] = src[0];
@@ -174,41 +194,6 @@ static quint32 permissionsToMode(QFile::Permissions perms)
     return mode;
 }
 
-static int inflate(Bytef *dest, ulong *destLen, const Bytef *source, ulong sourceLen)
-{
-    z_stream stream;
-    int err;
-
-    stream.next_in = (Bytef*)source;
-    stream.avail_in = (uInt)sourceLen;
-    if ((uLong)stream.avail_in != sourceLen)
-        return Z_BUF_ERROR;
-
-    stream.next_out = dest;
-    stream.avail_out = (uInt)*destLen;
-    if ((uLong)stream.avail_out != *destLen)
-        return Z_BUF_ERROR;
-
-    stream.zalloc = (alloc_func)0;
-    stream.zfree = (free_func)0;
-
-    err = inflateInit2(&stream, -MAX_WBITS);
-    if (err != Z_OK)
-        return err;
-
-    err = inflate(&stream, Z_FINISH);
-    if (err != Z_STREAM_END) {
-        inflateEnd(&stream);
-        if (err == Z_NEED_DICT || (err == Z_BUF_ERROR && stream.avail_in == 0))
-            return Z_DATA_ERROR;
-        return err;
-    }
-    *destLen = stream.total_out;
-
-    err = inflateEnd(&stream);
-    return err;
-}
-
 static int deflate (Bytef *dest, ulong *destLen, const Bytef *source, ulong sourceLen)
 {
     z_stream stream;
@@ -327,16 +312,146 @@ struct EndOfDirectory
     uchar comment_length[2];
 };
 
+struct Zip64EndOfDirectory
+{
+    uchar signature[4]; // 0x06064b50
+    uchar record_size[8];
+    uchar version_made[2];
+    uchar version_needed[2];
+    uchar this_disk[4];
+    uchar start_of_directory_disk[4];
+    uchar num_dir_entries_this_disk[8];
+    uchar num_dir_entries[8];
+    uchar directory_size[8];
+    uchar dir_start_offset[8];
+};
+
+struct Zip64EndOfDirectoryLocator
+{
+    uchar signature[4]; // 0x07064b50
+    uchar start_of_directory_disk[4];
+    uchar zip64_eod_offset[8];
+    uchar total_disks[4];
+};
+
+static const quint32 Zip64Marker = 0xffffffff;
+static const ushort Zip64ExtraId = 0x0001;
+static const ushort Zip64VersionNeeded = 45;
+
 struct FileHeader
 {
+    FileHeader()
+        : compressed_size(0), uncompressed_size(0), offset_local_header(0)
+    {
+    }
+
     CentralFileHeader h;
     QByteArray file_name;
     QByteArray extra_field;
     QByteArray file_comment;
+    // the real values, widened by the Zip64 extra field where needed
+    quint64 compressed_size;
+    quint64 uncompressed_size;
+    quint64 offset_local_header;
+
+    bool needsZip64() const;
+    void readSizes();
+    void writeSizes();
+    QByteArray localExtraField() const;
 };
 
+bool FileHeader::needsZip64() const
+{
+    return compressed_size >= Zip64Marker || uncompressed_size >= Zip64Marker
+        || offset_local_header >= Zip64Marker;
+}
+
+// Takes the sizes and offset from the central header, replacing the
+// fields marked 0xffffffff by their value in the Zip64 extra field.
+void FileHeader::readSizes()
+{
+    compressed_size = readUInt(h.compressed_size);
+    uncompressed_size = readUInt(h.uncompressed_size);
+    offset_local_header = readUInt(h.offset_local_header);
+
+    const uchar *extra = (const uchar *)extra_field.constData();
+    int pos = 0;
+    while (pos + 4 <= extra_field.size()) {
+        ushort id = readUShort(extra + pos);
+        int size = readUShort(extra + pos + 2);
+        pos += 4;
+        if (pos + size > extra_field.size())
+            break;
+        if (id == Zip64ExtraId) {
+            const uchar *field = extra + pos;
+            const uchar *end = field + size;
+            if (uncompressed_size == Zip64Marker && field + 8 <= end) {
+                uncompressed_size = readULongLong(field);
+                field += 8;
+            }
+            if (compressed_size == Zip64Marker && field + 8 <= end) {
+                compressed_size = readULongLong(field);
+                field += 8;
+            }
+            if (offset_local_header == Zip64Marker && field + 8 <= end)
+                offset_local_header = readULongLong(field);
+            return;
+        }
+        pos += size;
+    }
+}
+
+// Stores the sizes and offset into the central header, moving values that
+// do not fit 32 bits into a Zip64 extra field.
+void FileHeader::writeSizes()
+{
+    QByteArray zip64;
+    uchar value[8];
+    if (uncompressed_size >= Zip64Marker) {
+        writeULongLong(value, uncompressed_size);
+        zip64.append((const char *)value, 8);
+    }
+    if (compressed_size >= Zip64Marker) {
+        writeULongLong(value, compressed_size);
+        zip64.append((const char *)value, 8);
+    }
+    if (offset_local_header >= Zip64Marker) {
+        writeULongLong(value, offset_local_header);
+        zip64.append((const char *)value, 8);
+    }
+    writeUInt(h.uncompressed_size, qMin<quint64>(uncompressed_size, Zip64Marker));
+    writeUInt(h.compressed_size, qMin<quint64>(compressed_size, Zip64Marker));
+    writeUInt(h.offset_local_header, qMin<quint64>(offset_local_header, Zip64Marker));
+
+    extra_field.clear();
+    if (!zip64.isEmpty()) {
+        uchar tag[4];
+        writeUShort(tag, Zip64ExtraId);
+        writeUShort(tag + 2, zip64.size());
+        extra_field.append((const char *)tag, 4);
+        extra_field.append(zip64);
+        writeUShort(h.version_needed, Zip64VersionNeeded);
+    }
+    writeUShort(h.extra_field_length, extra_field.size());
+}
+
+// The local header carries both sizes in its Zip64 field, or nothing.
+QByteArray FileHeader::localExtraField() const
+{
+    QByteArray extra;
+    if (compressed_size < Zip64Marker && uncompressed_size < Zip64Marker)
+        return extra;
+    uchar field[20];
+    writeUShort(field, Zip64ExtraId);
+    writeUShort(field + 2, 16);
+    writeULongLong(field + 4, uncompressed_size);
+    writeULongLong(field + 12, compressed_size);
+    extra.append((const char *)field, 20);
+    return extra;
+}
+
 QZipReader::FileInfo::FileInfo()
-    : isDir(false), isFile(true), isSymLink(false), crc32(0), size(0)
+    : isDir(false), isFile(true), isSymLink(false), crc32(0), size(0), compressedSize(0)
 {
 }
 
@@ -358,6 +473,7 @@ QZipReader::FileInfo& QZipReader::FileInfo::operator=(const FileInfo &other)
     permissions = other.permissions;
     crc32 = other.crc32;
     size = other.size;
+    compressedSize = other.compressedSize;
     return *this;
 }
 
@@ -382,7 +498,7 @@ public:
     bool dirtyFileTree;
     QList<FileHeader> fileHeaders;
     QByteArray comment;
-    uint start_of_directory;
+    qint64 start_of_directory;
 };
 
 void QZipPrivate::fillFileInfo(int index, QZipReader::FileInfo &fileInfo) const
@@ -395,20 +511,46 @@ void QZipPrivate::fillFileInfo(int index, QZipReader::FileInfo &fileInfo) const
     fileInfo.isSymLink = S_ISLNK(mode);
     fileInfo.permissions = modeToPermissions(mode);
     fileInfo.crc32 = readUInt(header.h.crc_32);
-    fileInfo.size = readUInt(header.h.uncompressed_size);
+    fileInfo.size = header.uncompressed_size;
+    fileInfo.compressedSize = header.compressed_size;
 }
 
 class QZipReaderPrivate : public QZipPrivate
 {
 public:
     QZipReaderPrivate(QIODevice *device, bool ownDev)
-        : QZipPrivate(device, ownDev), status(QZipReader::NoError)
+        : QZipPrivate(device, ownDev), status(QZipReader::NoError),
+        mapped(0), mappedSize(0)
     {
     }
 
     void scanFiles();
+    void mapDevice();
+    void unmapDevice();
+    int indexOf(const QString &fileName) const;
+    QList<int> sortedByOffset(QList<int> indices) const;
+    qint64 dataStart(int index, int *compression_method, QIODevice *source);
+    QByteArray entryData(int index, bool shared = false);
+    QByteArray rawData(int index);
+    bool inflateTo(int index, QIODevice *sink, QIODevice *source);
+    bool extractFile(int index, const QString &absPath, QFile::Permissions permissions,
+                     QIODevice *source);
 
     QZipReader::Status status;
+    QHash<QString, int> fileIndex;
+    uchar *mapped;
+    qint64 mappedSize;
+};
+
+// An entry on its way into the archive. Its header is complete except for
+// the local header offset, which is assigned when the entry is written.
+struct QZipPendingEntry
+{
+    FileHeader header;
+    QByteArray contents;
+    QByteArray data;
+    QZipWriter::CompressionPolicy compression;
+    bool done;
 };
 
 class QZipWriterPrivate : public QZipPrivate
@@ -418,17 +560,37 @@ public:
         : QZipPrivate(device, ownDev),
         status(QZipWriter::NoError),
         permissions(QFile::ReadOwner | QFile::WriteOwner),
-        compressionPolicy(QZipWriter::AlwaysCompress)
+        compressionPolicy(QZipWriter::AlwaysCompress),
+        workerCount(1),
+        pool(0)
+    {
+    }
+
+    ~QZipWriterPrivate()
     {
+        delete pool;
+        qDeleteAll(pending);
     }
 
     QZipWriter::Status status;
     QFile::Permissions permissions;
     QZipWriter::CompressionPolicy compressionPolicy;
+    int workerCount;
+    QThreadPool *pool;
+    QList<QZipPendingEntry *> pending;
+    QMutex mutex;
+    QWaitCondition compressed;
 
     enum EntryType { Directory, File, Symlink };
 
     void addEntry(EntryType type, const QString &fileName, const QByteArray &contents);
+    void addRawEntry(const FileHeader &source, const QByteArray &data);
+    QZipPendingEntry *prepareEntry(EntryType type, const QString &fileName, const QByteArray &contents);
+    static void compressEntry(QZipPendingEntry *entry);
+    void writeEntry(QZipPendingEntry *entry);
+    void writeBytes(const char *data, qint64 size);
+    void writeBytes(const QByteArray &data) { writeBytes(data.constData(), data.size()); }
+    void flushPending(int keep);
 };
 
 LocalFileHeader CentralFileHeader::toLocalHeader() const
@@ -463,6 +625,7 @@ void QZipReaderPrivate::scanFiles()
     }
 
     dirtyFileTree = false;
+    mapDevice();
     uchar tmp[4];
     device->read((char *)tmp, 4);
     if (readUInt(tmp) != 0x04034b50) {
@@ -472,11 +635,12 @@ void QZipReaderPrivate::scanFiles()
 
     // find EndOfDirectory header
     int i = 0;
-    int start_of_directory = -1;
-    int num_dir_entries = 0;
+    qint64 start_of_directory = -1;
+    qint64 num_dir_entries = 0;
+    qint64 pos = 0;
     EndOfDirectory eod;
     while (start_of_directory == -1) {
-        int pos = device->size() - sizeof(EndOfDirectory) - i;
+        pos = device->size() - sizeof(EndOfDirectory) - i;
         if (pos < 0 || i > 65535) {
             qWarning() << "QZip: EndOfDirectory not found";
             return;
@@ -492,15 +656,33 @@ void QZipReaderPrivate::scanFiles()
     // have the eod
     start_of_directory = readUInt(eod.dir_start_offset);
     num_dir_entries = readUShort(eod.num_dir_entries);
-    ZDEBUG("start_of_directory at %d, num_dir_entries=%d", start_of_directory, num_dir_entries);
+    ZDEBUG("start_of_directory at %lld, num_dir_entries=%lld", start_of_directory, num_dir_entries);
     int comment_length = readUShort(eod.comment_length);
     if (comment_length != i)
         qWarning() << "QZip: failed to parse zip file.";
     comment = device->read(qMin(comment_length, i));
 
+    // a Zip64 locator right before the eod points to the 64 bit directory
+    if (pos >= (qint64)sizeof(Zip64EndOfDirectoryLocator)) {
+        Zip64EndOfDirectoryLocator locator;
+        device->seek(pos - sizeof(Zip64EndOfDirectoryLocator));
+        device->read((char *)&locator, sizeof(Zip64EndOfDirectoryLocator));
+        if (readUInt(locator.signature) == 0x07064b50) {
+            Zip64EndOfDirectory eod64;
+            device->seek(readULongLong(locator.zip64_eod_offset));
+            if (device->read((char *)&eod64, sizeof(Zip64EndOfDirectory)) == sizeof(Zip64EndOfDirectory)
+                && readUInt(eod64.signature) == 0x06064b50) {
+                start_of_directory = readULongLong(eod64.dir_start_offset);
+                num_dir_entries = readULongLong(eod64.num_dir_entries);
+                ZDEBUG("zip64 start_of_directory at %lld, num_dir_entries=%lld", start_of_directory, num_dir_entries);
+            } else {
+                qWarning() << "QZip: Zip64 EndOfDirectory not found";
+            }
+        }
+    }
 
     device->seek(start_of_directory);
-    for (i = 0; i < num_dir_entries; ++i) {
+    for (qint64 n = 0; n < num_dir_entries; ++n) {
         FileHeader header;
         int read = device->read((char *) &header.h, sizeof(CentralFileHeader));
         if (read < (int)sizeof(CentralFileHeader)) {
@@ -531,12 +713,292 @@ void QZipReaderPrivate::scanFiles()
             break;
         }
 
+        header.readSizes();
         ZDEBUG("found file '%s'", header.file_name.data());
+        // the first of duplicate names wins, as with a linear search
+        QString name = QString::fromLocal8Bit(header.file_name);
+        if (!fileIndex.contains(name))
+            fileIndex.insert(name, fileHeaders.size());
         fileHeaders.append(header);
     }
 }
 
-void QZipWriterPrivate::addEntry(EntryType type, const QString &fileName, const QByteArray &contents/*, QFile::Permissions permissions, QZip::Method m*/)
+int QZipReaderPrivate::indexOf(const QString &fileName) const
+{
+    return fileIndex.value(fileName, -1);
+}
+
+// Orders entry indices by their position in the archive so a batch of
+// reads walks the device forward instead of seeking back and forth.
+QList<int> QZipReaderPrivate::sortedByOffset(QList<int> indices) const
+{
+    QList<QPair<quint64, int> > offsets;
+    foreach (int index, indices)
+        offsets.append(qMakePair(fileHeaders.at(index).offset_local_header, index));
+    qSort(offsets);
+    QList<int> result;
+    for (int i = 0; i < offsets.size(); ++i)
+        result.append(offsets.at(i).second);
+    return result;
+}
+
+// Maps the whole archive when it is a plain file, so entries can be served
+// straight from the page cache. Falls back to device reads if mapping fails.
+void QZipReaderPrivate::mapDevice()
+{
+    QFile *f = qobject_cast<QFile*>(device);
+    if (f == 0 || mapped != 0)
+        return;
+    mapped = f->map(0, f->size());
+    if (mapped != 0)
+        mappedSize = f->size();
+}
+
+void QZipReaderPrivate::unmapDevice()
+{
+    if (mapped == 0)
+        return;
+    static_cast<QFile*>(device)->unmap(mapped);
+    mapped = 0;
+    mappedSize = 0;
+}
+
+// Returns the archive offset of the (possibly compressed) bytes of entry
+// \a index, or -1 if the local header can not be read. \a source is only
+// read when the archive is not mapped.
+qint64 QZipReaderPrivate::dataStart(int index, int *compression_method, QIODevice *source)
+{
+    const FileHeader &header = fileHeaders.at(index);
+    qint64 start = header.offset_local_header;
+    //qDebug("uncompressing file %d: local header at %d", i, start);
+
+    LocalFileHeader lh;
+    if (mapped) {
+        if (start + (qint64)sizeof(LocalFileHeader) > mappedSize)
+            return -1;
+        memcpy(&lh, mapped + start, sizeof(LocalFileHeader));
+    } else {
+        source->seek(start);
+        if (source->read((char *)&lh, sizeof(LocalFileHeader)) != sizeof(LocalFileHeader))
+            return -1;
+    }
+    uint skip = readUShort(lh.file_name_length) + readUShort(lh.extra_field_length);
+    *compression_method = readUShort(lh.compression_method);
+    return start + sizeof(LocalFileHeader) + skip;
+}
+
+// With \a shared, a stored entry of a mapped archive is returned as a
+// view on the mapping rather than a copy; it is only valid until the
+// archive is closed.
+QByteArray QZipReaderPrivate::entryData(int index, bool shared)
+{
+    const FileHeader &header = fileHeaders.at(index);
+
+    qint64 compressed_size = header.compressed_size;
+    qint64 uncompressed_size = header.uncompressed_size;
+    if (uncompressed_size > INT_MAX) {
+        qWarning() << "QZip: Entry too large for memory, use fileData(name, device)";
+        return QByteArray();
+    }
+
+    if (mapped) {
+        int compression_method;
+        qint64 start = dataStart(index, &compression_method, device);
+        if (compression_method == 0 && start >= 0 && start + compressed_size <= mappedSize) {
+            // no compression, the bytes are taken from the mapping as they are
+            const char *data = (const char *)mapped + start;
+            int size = int(qMin(compressed_size, uncompressed_size));
+            if (shared)
+                return QByteArray::fromRawData(data, size);
+            return QByteArray(data, size);
+        }
+    }
+
+    QByteArray contents;
+    contents.reserve(int(uncompressed_size));
+    QBuffer buffer(&contents);
+    buffer.open(QIODevice::WriteOnly);
+    if (!inflateTo(index, &buffer, device))
+        return QByteArray();
+    return contents;
+}
+
+// Returns the stored bytes of entry \a index exactly as they are in the
+// archive, without decompressing them.
+QByteArray QZipReaderPrivate::rawData(int index)
+{
+    qint64 compressed_size = fileHeaders.at(index).compressed_size;
+    if (compressed_size > INT_MAX)
+        return QByteArray();
+    int compression_method;
+    qint64 start = dataStart(index, &compression_method, device);
+    if (start < 0)
+        return QByteArray();
+    if (mapped) {
+        if (start + compressed_size > mappedSize)
+            return QByteArray();
+        return QByteArray((const char *)mapped + start, compressed_size);
+    }
+    device->seek(start);
+    QByteArray data = device->read(compressed_size);
+    if (data.size() != compressed_size)
+        return QByteArray();
+    return data;
+}
+
+static const int InflateChunkSize = 64 * 1024;
+
+// Decodes entry \a index into \a sink in fixed-size chunks, so memory use
+// does not depend on the entry size. Stored entries are copied through.
+bool QZipReaderPrivate::inflateTo(int index, QIODevice *sink, QIODevice *source)
+{
+    const FileHeader &header = fileHeaders.at(index);
+
+    qint64 compressed_size = header.compressed_size;
+    int compression_method;
+    qint64 start = dataStart(index, &compression_method, source);
+    if (start < 0) {
+        qWarning() << "QZip: Failed to read local header";
+        return false;
+    }
+    if (compression_method != 0 && compression_method != 8) {
+        qWarning() << "QZip: Unknown compression method";
+        return false;
+    }
+    if (mapped && start + compressed_size > mappedSize) {
+        qWarning() << "QZip: Entry exceeds archive size";
+        return false;
+    }
+    if (!mapped)
+        source->seek(start);
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(z_stream));
+    if (compression_method == 8 && inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        qWarning("QZip: Z_MEM_ERROR: Not enough memory");
+        return false;
+    }
+
+    uint crc_32 = ::crc32(0, 0, 0);
+    char out[InflateChunkSize];
+    QByteArray in;
+    qint64 remaining = compressed_size;
+    int res = Z_OK;
+    bool ok = true;
+    while (ok && res != Z_STREAM_END) {
+        const uchar *chunk;
+        int chunkSize = (int)qMin<qint64>(remaining, InflateChunkSize);
+        if (chunkSize == 0 && compression_method == 0)
+            break;
+        if (mapped) {
+            chunk = mapped + start + (compressed_size - remaining);
+        } else {
+            in = source->read(chunkSize);
+            if (in.size() != chunkSize) {
+                qWarning("QZip: Unexpected end of archive");
+                ok = false;
+                break;
+            }
+            chunk = (const uchar *)in.constData();
+        }
+        remaining -= chunkSize;
+
+        if (compression_method == 0) {
+            crc_32 = ::crc32(crc_32, chunk, chunkSize);
+            ok = sink->write((const char *)chunk, chunkSize) == chunkSize;
+            continue;
+        }
+
+        stream.next_in = (Bytef *)chunk;
+        stream.avail_in = chunkSize;
+        do {
+            stream.next_out = (Bytef *)out;
+            stream.avail_out = InflateChunkSize;
+            res = inflate(&stream, Z_NO_FLUSH);
+            if (res == Z_NEED_DICT || res == Z_DATA_ERROR
+                || (res == Z_BUF_ERROR && remaining == 0 && stream.avail_in == 0)) {
+                qWarning("QZip: Z_DATA_ERROR: Input data is corrupted");
+                ok = false;
+                break;
+            }
+            if (res == Z_MEM_ERROR) {
+                qWarning("QZip: Z_MEM_ERROR: Not enough memory");
+                ok = false;
+                break;
+            }
+            int produced = InflateChunkSize - stream.avail_out;
+            crc_32 = ::crc32(crc_32, (const uchar *)out, produced);
+            if (sink->write(out, produced) != produced) {
+                ok = false;
+                break;
+            }
+        } while (res != Z_STREAM_END && (stream.avail_in > 0 || stream.avail_out == 0));
+    }
+    if (compression_method == 8)
+        inflateEnd(&stream);
+
+    if (ok && crc_32 != readUInt(header.h.crc_32))
+        qWarning() << "QZip: CRC mismatch for" << header.file_name;
+    return ok;
+}
+
+bool QZipReaderPrivate::extractFile(int index, const QString &absPath,
+                                    QFile::Permissions permissions, QIODevice *source)
+{
+    QFile f(absPath);
+    if (!f.open(QIODevice::WriteOnly))
+        return false;
+    if (!inflateTo(index, &f, source))
+        return false;
+    f.setPermissions(permissions);
+    f.close();
+    return true;
+}
+
+// Worker of the parallel extractAll(). Each task claims the next entry
+// from a shared counter until the list is exhausted or an entry failed.
+// Without a mapping every task reads through its own file handle, since
+// a QIODevice position can not be shared between threads.
+class QZipExtractTask : public QRunnable
+{
+public:
+    QZipExtractTask(QZipReaderPrivate *d, const QList<int> &indices,
+                    const QStringList &paths, const QList<QFile::Permissions> &permissions,
+                    QAtomicInt *next, QAtomicInt *failed)
+        : d(d), indices(indices), paths(paths), permissions(permissions),
+          next(next), failed(failed)
+    {
+    }
+
+    void run()
+    {
+        QFile source;
+        if (!d->mapped) {
+            source.setFileName(static_cast<QFile*>(d->device)->fileName());
+            if (!source.open(QIODevice::ReadOnly)) {
+                failed->storeRelease(1);
+                return;
+            }
+        }
+        while (failed->loadAcquire() == 0) {
+            int n = next->fetchAndAddOrdered(1);
+            if (n >= indices.size())
+                break;
+            if (!d->extractFile(indices.at(n), paths.at(n), permissions.at(n), &source))
+                failed->storeRelease(1);
+        }
+    }
+
+private:
+    QZipReaderPrivate *d;
+    const QList<int> &indices;
+    const QStringList &paths;
+    const QList<QFile::Permissions> &permissions;
+    QAtomicInt *next;
+    QAtomicInt *failed;
+};
+
+QZipPendingEntry *QZipWriterPrivate::prepareEntry(EntryType type, const QString &fileName, const QByteArray &contents/*, QFile::Permissions permissions, QZip::Method m*/)
 {
 #ifndef NDEBUG
     static const char *entryTypes[] = {
@@ -546,30 +1008,56 @@ void QZipWriterPrivate::addEntry(EntryType type, const QString &fileName, const
     ZDEBUG() << "adding" << entryTypes[type] <<":" << fileName.toUtf8().data() << (type == 2 ? (" -> " + contents).constData() : "");
 #endif
 
-    if (! (device->isOpen() || device->open(QIODevice::WriteOnly))) {
-        status = QZipWriter::FileOpenError;
-        return;
-    }
-    device->seek(start_of_directory);
+    QZipPendingEntry *entry = new QZipPendingEntry;
+    entry->contents = contents;
+    entry->done = false;
 
     // don't compress small files
-    QZipWriter::CompressionPolicy compression = compressionPolicy;
+    entry->compression = compressionPolicy;
     if (compressionPolicy == QZipWriter::AutoCompress) {
         if (contents.length() < 64)
-            compression = QZipWriter::NeverCompress;
+            entry->compression = QZipWriter::NeverCompress;
         else
-            compression = QZipWriter::AlwaysCompress;
+            entry->compression = QZipWriter::AlwaysCompress;
     }
 
-    FileHeader header;
+    FileHeader &header = entry->header;
     memset(&header.h, 0, sizeof(CentralFileHeader));
     writeUInt(header.h.signature, 0x02014b50);
 
     writeUShort(header.h.version_needed, 0x14);
-    writeUInt(header.h.uncompressed_size, contents.length());
+    header.uncompressed_size = contents.length();
     writeMSDosDate(header.h.last_mod_file, QDateTime::currentDateTime());
+
+    header.file_name = fileName.toLocal8Bit();
+    if (header.file_name.size() > 0xffff) {
+        qWarning("QZip: Filename too long, chopping it to 65535 characters");
+        header.file_name = header.file_name.left(0xffff);
+    }
+    writeUShort(header.h.file_name_length, header.file_name.length());
+    //h.extra_field_length[2];
+
+    writeUShort(header.h.version_made, 3 << 8);
+    //uchar internal_file_attributes[2];
+    //uchar external_file_attributes[4];
+    quint32 mode = permissionsToMode(permissions);
+    switch (type) {
+        case File: mode |= S_IFREG; break;
+        case Directory: mode |= S_IFDIR; break;
+        case Symlink: mode |= S_IFLNK; break;
+    }
+    writeUInt(header.h.external_file_attributes, mode << 16);
+    return entry;
+}
+
+// Fills in the data, sizes and checksum of \a entry. Touches nothing but
+// the entry itself, so it may run on a worker thread.
+void QZipWriterPrivate::compressEntry(QZipPendingEntry *entry)
+{
+    FileHeader &header = entry->header;
+    const QByteArray &contents = entry->contents;
     QByteArray data = contents;
-    if (compression == QZipWriter::AlwaysCompress) {
+    if (entry->compression == QZipWriter::AlwaysCompress) {
         writeUShort(header.h.compression_method, 8);
 
        ulong len = contents.length();
@@ -595,42 +1083,154 @@ void QZipWriterPrivate::addEntry(EntryType type, const QString &fileName, const
         } while (res == Z_BUF_ERROR);
     }
 // TODO add a check if data.length() > contents.length().  Then try to store the original and revert the compression method to be uncompressed
-    writeUInt(header.h.compressed_size, data.length());
+    header.compressed_size = data.length();
     uint crc_32 = ::crc32(0, 0, 0);
     crc_32 = ::crc32(crc_32, (const uchar *)contents.constData(), contents.length());
     writeUInt(header.h.crc_32, crc_32);
 
-    header.file_name = fileName.toLocal8Bit();
-    if (header.file_name.size() > 0xffff) {
-        qWarning("QZip: Filename too long, chopping it to 65535 characters");
-        header.file_name = header.file_name.left(0xffff);
-    }
-    writeUShort(header.h.file_name_length, header.file_name.length());
-    //h.extra_field_length[2];
-
-    writeUShort(header.h.version_made, 3 << 8);
-    //uchar internal_file_attributes[2];
-    //uchar external_file_attributes[4];
-    quint32 mode = permissionsToMode(permissions);
-    switch (type) {
-        case File: mode |= S_IFREG; break;
-        case Directory: mode |= S_IFDIR; break;
-        case Symlink: mode |= S_IFLNK; break;
-    }
-    writeUInt(header.h.external_file_attributes, mode << 16);
-    writeUInt(header.h.offset_local_header, start_of_directory);
+    entry->data = data;
+    entry->contents = QByteArray();
+}
 
+void QZipWriterPrivate::writeEntry(QZipPendingEntry *entry)
+{
+    device->seek(start_of_directory);
 
+    FileHeader &header = entry->header;
+    header.offset_local_header = start_of_directory;
+    header.writeSizes();
     fileHeaders.append(header);
 
     LocalFileHeader h = header.h.toLocalHeader();
-    device->write((const char *)&h, sizeof(LocalFileHeader));
-    device->write(header.file_name);
-    device->write(data);
+    QByteArray localExtra = header.localExtraField();
+    if (!localExtra.isEmpty()) {
+        writeUInt(h.compressed_size, Zip64Marker);
+        writeUInt(h.uncompressed_size, Zip64Marker);
+    }
+    writeUShort(h.extra_field_length, localExtra.size());
+    writeBytes((const char *)&h, sizeof(LocalFileHeader));
+    writeBytes(header.file_name);
+    writeBytes(localExtra);
+    writeBytes(entry->data);
     start_of_directory = device->pos();
     dirtyFileTree = true;
 }
 
+// Writes to the device and records a short write in status, which
+// stays set for the rest of the archive.
+void QZipWriterPrivate::writeBytes(const char *data, qint64 size)
+{
+    if (size > 0 && device->write(data, size) != size)
+        status = QZipWriter::FileWriteError;
+}
+
+class QZipCompressTask : public QRunnable
+{
+public:
+    QZipCompressTask(QZipWriterPrivate *d, QZipPendingEntry *entry)
+        : d(d), entry(entry)
+    {
+    }
+
+    void run()
+    {
+        QZipWriterPrivate::compressEntry(entry);
+        QMutexLocker locker(&d->mutex);
+        entry->done = true;
+        d->compressed.wakeAll();
+    }
+
+private:
+    QZipWriterPrivate *d;
+    QZipPendingEntry *entry;
+};
+
+// Writes pending entries in the order they were added, waiting for their
+// compression to finish, until at most \a keep entries remain in flight.
+void QZipWriterPrivate::flushPending(int keep)
+{
+    while (pending.size() > keep) {
+        QZipPendingEntry *entry = pending.first();
+        {
+            QMutexLocker locker(&mutex);
+            while (!entry->done)
+                compressed.wait(&mutex);
+        }
+        pending.removeFirst();
+        writeEntry(entry);
+        delete entry;
+    }
+    // also write whatever already finished at the head of the queue
+    while (!pending.isEmpty()) {
+        QZipPendingEntry *entry = pending.first();
+        {
+            QMutexLocker locker(&mutex);
+            if (!entry->done)
+                break;
+        }
+        pending.removeFirst();
+        writeEntry(entry);
+        delete entry;
+    }
+}
+
+// Queues an entry whose data is already in its final, stored form. The
+// header keeps the checksum, sizes, method, date and attributes of
+// \a source; fields this writer does not produce are dropped.
+void QZipWriterPrivate::addRawEntry(const FileHeader &source, const QByteArray &data)
+{
+    if (! (device->isOpen() || device->open(QIODevice::WriteOnly))) {
+        status = QZipWriter::FileOpenError;
+        return;
+    }
+
+    QZipPendingEntry *entry = new QZipPendingEntry;
+    entry->header.h = source.h;
+    entry->header.file_name = source.file_name;
+    entry->header.compressed_size = source.compressed_size;
+    entry->header.uncompressed_size = source.uncompressed_size;
+    // sizes are known up front, so no trailing data descriptor is written
+    writeUShort(entry->header.h.general_purpose_bits,
+                readUShort(source.h.general_purpose_bits) & ~0x0008);
+    writeUShort(entry->header.h.file_comment_length, 0);
+    writeUShort(entry->header.h.disk_start, 0);
+    entry->data = data;
+    entry->compression = QZipWriter::NeverCompress;
+    entry->done = true;
+
+    if (workerCount < 2) {
+        writeEntry(entry);
+        delete entry;
+        return;
+    }
+    pending.append(entry);
+    flushPending(2 * workerCount);
+}
+
+void QZipWriterPrivate::addEntry(EntryType type, const QString &fileName, const QByteArray &contents)
+{
+    if (! (device->isOpen() || device->open(QIODevice::WriteOnly))) {
+        status = QZipWriter::FileOpenError;
+        return;
+    }
+
+    QZipPendingEntry *entry = prepareEntry(type, fileName, contents);
+    if (workerCount < 2) {
+        compressEntry(entry);
+        writeEntry(entry);
+        delete entry;
+        return;
+    }
+
+    if (pool == 0) {
+        pool = new QThreadPool;
+        pool->setMaxThreadCount(workerCount);
+    }
+    pending.append(entry);
+    pool->start(new QZipCompressTask(this, entry));
+    flushPending(2 * workerCount);
+}
+
 //////////////////////////////  Reader
 
 /*!
@@ -760,6 +1360,18 @@ bool QZipReader::exists() const
     return f->exists();
 }
 
+/*!
+    Returns true if the archive is read through a memory mapping. Once
+    the index has been read, the entries of a mapped archive can be
+    fetched from several threads at once, since fileData() then touches
+    no device position or other shared state.
+*/
+bool QZipReader::isMapped() const
+{
+    d->scanFiles();
+    return d->mapped != 0;
+}
+
 /*!
     Returns the list of files the archive contains.
 */
@@ -799,74 +1411,96 @@ QZipReader::FileInfo QZipReader::entryInfoAt(int index) const
     return fi;
 }
 
+/*!
+    Returns a FileInfo of the entry named \a fileName, taken from the
+    central directory without touching the entry data.
+    If there is no such entry, the returned FileInfo has an empty
+    filePath.
+*/
+QZipReader::FileInfo QZipReader::entryInfo(const QString &fileName) const
+{
+    d->scanFiles();
+    QZipReader::FileInfo fi;
+    int i = d->indexOf(fileName);
+    if (i != -1)
+        d->fillFileInfo(i, fi);
+    return fi;
+}
+
 /*!
     Fetch the file contents from the zip archive and return the uncompressed bytes.
+
+    The returned bytes are owned by the caller and stay valid after the
+    reader is closed.
+
+    \sa fileDataView(), fileData(const QString &, QIODevice *)
 */
 QByteArray QZipReader::fileData(const QString &fileName) const
 {
     d->scanFiles();
-    int i;
-    for (i = 0; i < d->fileHeaders.size(); ++i) {
-        if (QString::fromLocal8Bit(d->fileHeaders.at(i).file_name) == fileName)
-            break;
-    }
-    if (i == d->fileHeaders.size())
+    int i = d->indexOf(fileName);
+    if (i == -1)
         return QByteArray();
+    return d->entryData(i);
+}
 
-    FileHeader header = d->fileHeaders.at(i);
+/*!
+    Like fileData(), but when the archive is memory mapped, stored (not
+    compressed) entries are returned as a view on the mapping without
+    copying. The result must not be used after close() or after the
+    reader is destroyed; use it only to consume the bytes right away.
+*/
+QByteArray QZipReader::fileDataView(const QString &fileName) const
+{
+    d->scanFiles();
+    int i = d->indexOf(fileName);
+    if (i == -1)
+        return QByteArray();
+    return d->entryData(i, true);
+}
 
-    int compressed_size = readUInt(header.h.compressed_size);
-    int uncompressed_size = readUInt(header.h.uncompressed_size);
-    int start = readUInt(header.h.offset_local_header);
-    //qDebug("uncompressing file %d: local header at %d", i, start);
+/*!
+    Decode the contents of \a fileName into \a device, which must already
+    be open for writing. The entry is inflated in fixed-size chunks, so
+    memory use stays bounded however large the entry is, and the device
+    may parse the data while it is being decompressed.
+    Returns false if the entry is missing or could not be decoded.
+*/
+bool QZipReader::fileData(const QString &fileName, QIODevice *device) const
+{
+    Q_ASSERT(device);
+    d->scanFiles();
+    int i = d->indexOf(fileName);
+    if (i == -1)
+        return false;
+    return d->inflateTo(i, device, d->device);
+}
 
-    d->device->seek(start);
-    LocalFileHeader lh;
-    d->device->read((char *)&lh, sizeof(LocalFileHeader));
-    uint skip = readUShort(lh.file_name_length) + readUShort(lh.extra_field_length);
-    d->device->seek(d->device->pos() + skip);
-
-    int compression_method = readUShort(lh.compression_method);
-    //qDebug("file=%s: compressed_size=%d, uncompressed_size=%d", fileName.toLocal8Bit().data(), compressed_size, uncompressed_size);
-
-    //qDebug("file at %lld", d->device->pos());
-    QByteArray compressed = d->device->read(compressed_size);
-    if (compression_method == 0) {
-        // no compression
-        compressed.truncate(uncompressed_size);
-        return compressed;
-    } else if (compression_method == 8) {
-        // Deflate
-        //qDebug("compressed=%d", compressed.size());
-        compressed.truncate(compressed_size);
-        QByteArray baunzip;
-        ulong len = qMax(uncompressed_size,  1);
-        int res;
-        do {
-            baunzip.resize(len);
-            res = inflate((uchar*)baunzip.data(), &len,
-                          (uchar*)compressed.constData(), compressed_size);
+/*!
+    Fetch the contents of all \a fileNames in a single pass over the archive
+    and return the uncompressed bytes in the same order as requested.
+    Entries that are not found are returned as empty byte arrays.
 
-            switch (res) {
-            case Z_OK:
-                if ((int)len != baunzip.size())
-                    baunzip.resize(len);
-                break;
-            case Z_MEM_ERROR:
-                qWarning("QZip: Z_MEM_ERROR: Not enough memory");
-                break;
-            case Z_BUF_ERROR:
-                len *= 2;
-                break;
-            case Z_DATA_ERROR:
-                qWarning("QZip: Z_DATA_ERROR: Input data is corrupted");
-                break;
-            }
-        } while (res == Z_BUF_ERROR);
-        return baunzip;
+    The entries are read in the order they are stored, so fetching many
+    entries at once avoids seeking back and forth over the device.
+*/
+QList<QByteArray> QZipReader::fileDataList(const QStringList &fileNames) const
+{
+    d->scanFiles();
+    QList<int> found;
+    foreach (const QString &fileName, fileNames) {
+        int i = d->indexOf(fileName);
+        if (i != -1)
+            found.append(i);
     }
-    qWarning() << "QZip: Unknown compression method";
-    return QByteArray();
+    QHash<int, QByteArray> contents;
+    foreach (int i, d->sortedByOffset(found))
+        contents.insert(i, d->entryData(i));
+
+    QList<QByteArray> result;
+    foreach (const QString &fileName, fileNames)
+        result.append(contents.value(d->indexOf(fileName)));
+    return result;
 }
 
 /*!
@@ -875,12 +1509,26 @@ QByteArray QZipReader::fileData(const QString &fileName) const
     In case writing or linking a file fails, the extraction will be aborted.
 */
 bool QZipReader::extractAll(const QString &destinationDir) const
+{
+    return extractAll(destinationDir, 1);
+}
+
+/*!
+    Extracts the full contents of the zip file into \a destinationDir,
+    inflating and writing the files on up to \a workerCount threads.
+    Directories and symbolic links are still created first on the calling
+    thread. Archives that are neither mapped nor backed by a QFile are
+    always extracted serially.
+*/
+bool QZipReader::extractAll(const QString &destinationDir, int workerCount) const
 {
     QDir baseDir(destinationDir);
 
     // create directories first
     QList<FileInfo> allFiles = fileInfoList();
-    foreach (FileInfo fi, allFiles) {
+    QList<int> files;
+    for (int i = 0; i < allFiles.size(); ++i) {
+        const FileInfo &fi = allFiles.at(i);
         const QString absPath = destinationDir + QDir::separator() + fi.filePath;
         if (fi.isDir) {
             if (!baseDir.mkpath(fi.filePath))
@@ -891,10 +1539,13 @@ bool QZipReader::extractAll(const QString &destinationDir) const
     }
 
     // set up symlinks
-    foreach (FileInfo fi, allFiles) {
+    for (int i = 0; i < allFiles.size(); ++i) {
+        const FileInfo &fi = allFiles.at(i);
         const QString absPath = destinationDir + QDir::separator() + fi.filePath;
+        if (fi.isFile)
+            files.append(i);
         if (fi.isSymLink) {
-            QString destination = QFile::decodeName(fileData(fi.filePath));
+            QString destination = QFile::decodeName(d->entryData(i));
             if (destination.isEmpty())
                 return false;
             QFileInfo linkFi(absPath);
@@ -909,19 +1560,33 @@ bool QZipReader::extractAll(const QString &destinationDir) const
         }
     }
 
-    foreach (FileInfo fi, allFiles) {
-        const QString absPath = destinationDir + QDir::separator() + fi.filePath;
-        if (fi.isFile) {
-            QFile f(absPath);
-            if (!f.open(QIODevice::WriteOnly))
+    QList<int> indices = d->sortedByOffset(files);
+    QStringList paths;
+    QList<QFile::Permissions> permissions;
+    foreach (int i, indices) {
+        const FileInfo &fi = allFiles.at(i);
+        paths.append(destinationDir + QDir::separator() + fi.filePath);
+        permissions.append(fi.permissions);
+    }
+
+    bool parallel = d->mapped || qobject_cast<QFile*>(d->device) != 0;
+    workerCount = qMin(workerCount, indices.size());
+    if (!parallel || workerCount < 2) {
+        for (int n = 0; n < indices.size(); ++n) {
+            if (!d->extractFile(indices.at(n), paths.at(n), permissions.at(n), d->device))
                 return false;
-            f.write(fileData(fi.filePath));
-            f.setPermissions(fi.permissions);
-            f.close();
         }
+        return true;
     }
 
-    return true;
+    QAtomicInt next(0);
+    QAtomicInt failed(0);
+    QThreadPool pool;
+    pool.setMaxThreadCount(workerCount);
+    for (int t = 0; t < workerCount; ++t)
+        pool.start(new QZipExtractTask(d, indices, paths, permissions, &next, &failed));
+    pool.waitForDone();
+    return failed.loadAcquire() == 0;
 }
 
 /*!
@@ -950,6 +1615,7 @@ QZipReader::Status QZipReader::status() const
 */
 void QZipReader::close()
 {
+    d->unmapDevice();
     d->device->close();
 }
 
@@ -1107,6 +1773,31 @@ QFile::Permissions QZipWriter::creationPermissions() const
     return d->permissions;
 }
 
+/*!
+    Sets the number of threads used to compress added files to \a count.
+    With more than one worker, addFile() queues the file for compression
+    and returns; entries are still written in the order they were added,
+    so the archive layout does not depend on the worker count.
+
+    \note the default is a single worker, compressing on the calling thread.
+*/
+void QZipWriter::setWorkerCount(int count)
+{
+    d->flushPending(0);
+    d->workerCount = qMax(count, 1);
+    if (d->pool)
+        d->pool->setMaxThreadCount(d->workerCount);
+}
+
+/*!
+    Returns the number of threads used to compress added files.
+    \sa setWorkerCount()
+*/
+int QZipWriter::workerCount() const
+{
+    return d->workerCount;
+}
+
 /*!
     Add a file to the archive with \a data as the file contents.
     The file will be stored in the archive using the \a fileName which
@@ -1148,6 +1839,28 @@ void QZipWriter::addFile(const QString &fileName, QIODevice *device)
         device->close();
 }
 
+/*!
+    Copy the entry \a fileName of the archive read by \a source into this
+    archive without decompressing and recompressing it. The stored bytes,
+    checksum and sizes are kept as they are, only the position in the new
+    archive changes.
+    Returns false if \a source has no such entry or it could not be read.
+*/
+bool QZipWriter::copyEntry(const QZipReader &source, const QString &fileName)
+{
+    QZipReaderPrivate *sd = source.d;
+    sd->scanFiles();
+    int i = sd->indexOf(fileName);
+    if (i == -1)
+        return false;
+    const FileHeader &header = sd->fileHeaders.at(i);
+    QByteArray data = sd->rawData(i);
+    if ((quint64)data.size() != header.compressed_size)
+        return false;
+    d->addRawEntry(header, data);
+    return true;
+}
+
 /*!
     Create a new directory in the archive with the specified \a dirName and
     the \a permissions;
@@ -1177,10 +1890,12 @@ void QZipWriter::addSymLink(const QString &fileName, const QString &destination)
 }
 
 /*!
-   Closes the zip file.
+   Closes the zip file. A write that failed anywhere in the archive,
+   including the final flush, is reported by status() afterwards.
 */
 void QZipWriter::close()
 {
+    d->flushPending(0);
     if (!(d->device->openMode() & QIODevice::WriteOnly)) {
         d->device->close();
         return;
@@ -1191,26 +1906,55 @@ void QZipWriter::close()
     // write new directory
     for (int i = 0; i < d->fileHeaders.size(); ++i) {
         const FileHeader &header = d->fileHeaders.at(i);
-        d->device->write((const char *)&header.h, sizeof(CentralFileHeader));
-        d->device->write(header.file_name);
-        d->device->write(header.extra_field);
-        d->device->write(header.file_comment);
+        d->writeBytes((const char *)&header.h, sizeof(CentralFileHeader));
+        d->writeBytes(header.file_name);
+        d->writeBytes(header.extra_field);
+        d->writeBytes(header.file_comment);
     }
-    int dir_size = d->device->pos() - d->start_of_directory;
+    qint64 dir_size = d->device->pos() - d->start_of_directory;
+    quint64 num_dir_entries = d->fileHeaders.size();
+
+    // past 65535 entries or 4 GB the directory is described by Zip64 records
+    if (num_dir_entries >= 0xffff || (quint64)d->start_of_directory >= Zip64Marker
+        || (quint64)dir_size >= Zip64Marker) {
+        qint64 zip64_eod_offset = d->device->pos();
+        Zip64EndOfDirectory eod64;
+        memset(&eod64, 0, sizeof(Zip64EndOfDirectory));
+        writeUInt(eod64.signature, 0x06064b50);
+        writeULongLong(eod64.record_size, sizeof(Zip64EndOfDirectory) - 12);
+        writeUShort(eod64.version_made, (3 << 8) | Zip64VersionNeeded);
+        writeUShort(eod64.version_needed, Zip64VersionNeeded);
+        writeULongLong(eod64.num_dir_entries_this_disk, num_dir_entries);
+        writeULongLong(eod64.num_dir_entries, num_dir_entries);
+        writeULongLong(eod64.directory_size, dir_size);
+        writeULongLong(eod64.dir_start_offset, d->start_of_directory);
+        d->writeBytes((const char *)&eod64, sizeof(Zip64EndOfDirectory));
+
+        Zip64EndOfDirectoryLocator locator;
+        memset(&locator, 0, sizeof(Zip64EndOfDirectoryLocator));
+        writeUInt(locator.signature, 0x07064b50);
+        writeULongLong(locator.zip64_eod_offset, zip64_eod_offset);
+        writeUInt(locator.total_disks, 1);
+        d->writeBytes((const char *)&locator, sizeof(Zip64EndOfDirectoryLocator));
+    }
+
     // write end of directory
     EndOfDirectory eod;
     memset(&eod, 0, sizeof(EndOfDirectory));
     writeUInt(eod.signature, 0x06054b50);
     //uchar this_disk[2];
     //uchar start_of_directory_disk[2];
-    writeUShort(eod.num_dir_entries_this_disk, d->fileHeaders.size());
-    writeUShort(eod.num_dir_entries, d->fileHeaders.size());
-    writeUInt(eod.directory_size, dir_size);
-    writeUInt(eod.dir_start_offset, d->start_of_directory);
+    writeUShort(eod.num_dir_entries_this_disk, qMin<quint64>(num_dir_entries, 0xffff));
+    writeUShort(eod.num_dir_entries, qMin<quint64>(num_dir_entries, 0xffff));
+    writeUInt(eod.directory_size, qMin<quint64>(dir_size, Zip64Marker));
+    writeUInt(eod.dir_start_offset, qMin<quint64>(d->start_of_directory, Zip64Marker));
     writeUShort(eod.comment_length, d->comment.length());
 
-    d->device->write((const char *)&eod, sizeof(EndOfDirectory));
-    d->device->write(d->comment);
+    d->writeBytes((const char *)&eod, sizeof(EndOfDirectory));
+    d->writeBytes(d->comment);
+    QFileDevice *file = qobject_cast<QFileDevice *>(d->device);
+    if (file != 0 && !file->flush())
+        d->status = FileWriteError;
     d->device->close();
 }
 
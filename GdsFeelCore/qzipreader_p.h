@@ -57,6 +57,7 @@
 
 #include <QtCore/qfile.h>
 #include <QtCore/qstring.h>
+#include <QtCore/qstringlist.h>
 
 QT_BEGIN_NAMESPACE
 
@@ -72,6 +73,7 @@ public:
 
     bool isReadable() const;
     bool exists() const;
+    bool isMapped() const;
 
     struct Q_AUTOTEST_EXPORT FileInfo
     {
@@ -86,6 +88,7 @@ public:
         QFile::Permissions permissions;
         uint crc32;
         qint64 size;
+        qint64 compressedSize;
         void *d;
     };
 
@@ -93,8 +96,13 @@ public:
     int count() const;
 
     FileInfo entryInfoAt(int index) const;
+    FileInfo entryInfo(const QString &fileName) const;
     QByteArray fileData(const QString &fileName) const;
+    QByteArray fileDataView(const QString &fileName) const;
+    bool fileData(const QString &fileName, QIODevice *device) const;
+    QList<QByteArray> fileDataList(const QStringList &fileNames) const;
     bool extractAll(const QString &destinationDir) const;
+    bool extractAll(const QString &destinationDir, int workerCount) const;
 
     enum Status {
         NoError,
@@ -109,6 +117,7 @@ public:
     void close();
 
 private:
+    friend class QZipWriter;
     QZipReaderPrivate *d;
     Q_DISABLE_COPY(QZipReader)
 };
@@ -59,6 +59,7 @@
 QT_BEGIN_NAMESPACE
 
 class QZipWriterPrivate;
+class QZipReader;
 
 
 class Q_AUTOTEST_EXPORT QZipWriter
@@ -94,10 +95,15 @@ public:
     void setCreationPermissions(QFile::Permissions permissions);
     QFile::Permissions creationPermissions() const;
 
+    void setWorkerCount(int count);
+    int workerCount() const;
+
     void addFile(const QString &fileName, const QByteArray &data);
 
     void addFile(const QString &fileName, QIODevice *device);
 
+    bool copyEntry(const QZipReader &source, const QString &fileName);
+
     void addDirectory(const QString &dirName);
 
     void addSymLink(const QString &fileName, const QString &destination);
@@ -0,0 +1,188 @@
+#include <QtCore/QDebug>
+#include <QtCore/qmath.h>
+
+#include "regionquery.h"
+#include "structure.h"
+#include "library.h"
+#include "element.h"
+#include "spatialindex.h"
+#include "elementstore.h"
+#include "geometrycache.h"
+
+namespace Gds {
+
+const int DEFAULT_MAX_DEPTH = 64;
+
+static bool overlaps(const QRectF &a, const QRectF &b)
+{
+  return a.left() <= b.right() && b.left() <= a.right()
+      && a.top() <= b.bottom() && b.top() <= a.bottom();
+}
+
+
+// The placements i in [0, count) whose offset i * step lies within
+// [low, high]; last < first when there is none.
+static void stepRange(double low, double high, double step, int count,
+                      int &first, int &last)
+{
+  first = 0;
+  last = -1;
+  if (step == 0.0) {
+    if (low <= 0.0 && 0.0 <= high) {
+      last = count - 1;
+    }
+    return;
+  }
+  double a = low / step;
+  double b = high / step;
+  if (step < 0.0) {
+    qSwap(a, b);
+  }
+  first = qCeil(qBound(0.0, a, (double) count));
+  last = qFloor(qBound(-1.0, b, count - 1.0));
+}
+
+
+RegionQuery::RegionQuery(Structure *top)
+{
+  _top = top;
+  _layerNumber = SpatialIndex::AnyLayer;
+  _maxDepth = DEFAULT_MAX_DEPTH;
+  _visited = 0;
+}
+
+
+RegionQuery::~RegionQuery()
+{
+  foreach (Structure *s, _pinned) {
+    if (s->library() != nullptr) {
+      s->library()->geometryCache()->unpin(s);
+    }
+  }
+}
+
+
+// Only primitives on layerNumber are returned; references are followed
+// whatever their layer.
+void RegionQuery::setLayerNumber(int layerNumber)
+{
+  _layerNumber = layerNumber;
+}
+
+
+// Limits how deep references are followed; cycles are cut whatever the
+// depth.
+void RegionQuery::setMaxDepth(int depth)
+{
+  _maxDepth = depth;
+}
+
+
+// window is in the coordinates of the top structure, as are the hit
+// transforms.
+QList<RegionHit> RegionQuery::run(const QRectF &window)
+{
+  _hits.clear();
+  _visiting.clear();
+  _visited = 0;
+  visit(_top, window, QMatrix(), 0);
+  return _hits;
+}
+
+
+void RegionQuery::pin(Structure *structure)
+{
+  if (_pinned.contains(structure) || structure->library() == nullptr) {
+    return;
+  }
+  structure->library()->geometryCache()->pin(structure);
+  _pinned.insert(structure);
+}
+
+
+// window is in the coordinates of structure; toTop maps them to the
+// top structure's.
+void RegionQuery::visit(Structure *structure, const QRectF &window,
+                        const QMatrix &toTop, int depth)
+{
+  _visited++;
+  pin(structure);
+  _visiting.insert(structure);
+  const ElementStore &elements = structure->elements();
+  foreach (int i, structure->spatialIndex().query(window)) {
+    ElementView view = elements.at(i);
+    if (view.isPrimitive()) {
+      visitPrimitive(structure, i, view.layerNumber(), toTop);
+    }
+    else if (view.isReference() && depth < _maxDepth) {
+      visitReference(structure, view, window, toTop, depth);
+    }
+  }
+  _visiting.remove(structure);
+}
+
+
+void RegionQuery::visitPrimitive(Structure *structure, int index, int layerNumber,
+                                 const QMatrix &toTop)
+{
+  if (_layerNumber != SpatialIndex::AnyLayer && layerNumber != _layerNumber) {
+    return;
+  }
+  RegionHit hit;
+  hit.structure = structure;
+  hit.index = index;
+  hit.transform = toTop;
+  _hits.append(hit);
+}
+
+
+// Placement (row, column) maps a child point p to transform() of
+// p + (column * columnStep, row * rowStep), as in Aref::transforms(); a
+// Sref is the single placement (0, 0). Only offsets that can bring the
+// child bounds into the window are visited.
+void RegionQuery::visitReference(Structure *structure, const ElementView &view,
+                                 const QRectF &window, const QMatrix &toTop, int depth)
+{
+  if (structure->library() == nullptr) {
+    return;
+  }
+  Structure *child = structure->library()->structureNamed(view.referenceName());
+  if (child == nullptr) {
+    qDebug() << "structure not found: " << view.referenceName() << endl;
+    return;
+  }
+  if (_visiting.contains(child)) {
+    qDebug() << "reference cycle: " << structure->name() << "->" << child->name() << endl;
+    return;
+  }
+  QMatrix mat = view.transform();
+  double rowStep = view.rowStep();
+  double columnStep = view.columnStep();
+  bool invertible = false;
+  QMatrix inverse = mat.inverted(&invertible);
+  if (! invertible) {
+    return;
+  }
+  QRectF local = inverse.mapRect(window);
+  QRectF bounds = child->dataBounds();
+  int firstColumn, lastColumn, firstRow, lastRow;
+  stepRange(local.left() - bounds.right(), local.right() - bounds.left(),
+            columnStep, view.columnCount(), firstColumn, lastColumn);
+  stepRange(local.top() - bounds.bottom(), local.bottom() - bounds.top(),
+            rowStep, view.rowCount(), firstRow, lastRow);
+  for (int ri = firstRow; ri <= lastRow; ri++) {
+    for (int ci = firstColumn; ci <= lastColumn; ci++) {
+      double xOffset = ci * columnStep;
+      double yOffset = ri * rowStep;
+      QRectF childWindow = local.translated(-xOffset, -yOffset);
+      if (! overlaps(childWindow, bounds)) {
+        continue;
+      }
+      QMatrix placement(mat);
+      placement.translate(xOffset, yOffset);
+      visit(child, childWindow, placement * toTop, depth + 1);
+    }
+  }
+}
+
+} // namespace Gds
@@ -0,0 +1,68 @@
+#ifndef REGIONQUERY_H
+#define REGIONQUERY_H
+
+#include <QtCore/QRectF>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QMatrix>
+
+namespace Gds {
+
+class Structure;
+class ElementView;
+
+
+// A primitive found by RegionQuery: entry index of structure's
+// elements(), and the transform from the structure's coordinates to the
+// top structure's.
+struct RegionHit
+{
+  Structure *structure;
+  int index;
+  QMatrix transform;
+};
+
+
+// Finds the primitives of a structure and of everything it references
+// that lie in a window, without flattening the hierarchy. The window is
+// carried into each child with the inverse of the reference transform;
+// children whose bounds miss it are not read, and of an array only the
+// rows and columns that can reach the window are visited. Elements are
+// read through their views, so no element objects are built.
+//
+// A reference back into a structure that is being visited is a cycle
+// and is not followed.
+//
+// Visited structures are pinned in the geometry cache while the query
+// lives, so the hits remain valid until it is destroyed.
+class RegionQuery
+{
+public:
+  RegionQuery(Structure *top);
+  ~RegionQuery();
+
+  void setLayerNumber(int layerNumber);
+  void setMaxDepth(int depth);
+  int visitedPlacements() const { return _visited; }
+
+  QList<RegionHit> run(const QRectF &window);
+
+private:
+  void visit(Structure *structure, const QRectF &window, const QMatrix &toTop, int depth);
+  void visitPrimitive(Structure *structure, int index, int layerNumber, const QMatrix &toTop);
+  void visitReference(Structure *structure, const ElementView &view,
+                      const QRectF &window, const QMatrix &toTop, int depth);
+  void pin(Structure *structure);
+
+  Structure *_top;
+  int _layerNumber;
+  int _maxDepth;
+  int _visited;
+  QSet<Structure*> _pinned;
+  QSet<Structure*> _visiting;
+  QList<RegionHit> _hits;
+};
+
+} // namespace Gds
+
+#endif // REGIONQUERY_H
@@ -0,0 +1,162 @@
+#include <QtCore/QVarLengthArray>
+#include <QtCore/QtAlgorithms>
+#include <QtCore/qmath.h>
+
+#include "spatialindex.h"
+
+namespace Gds {
+
+const int NODE_CAPACITY = 16;
+
+// Unlike QRectF::intersects(), rects without width or height count, as
+// do rects that only touch.
+static bool overlaps(const QRectF &a, const QRectF &b)
+{
+  return a.left() <= b.right() && b.left() <= a.right()
+      && a.top() <= b.bottom() && b.top() <= a.bottom();
+}
+
+
+// QRectF::united() skips empty rects, which lines and points are.
+static QRectF unite(const QRectF &a, const QRectF &b)
+{
+  QRectF result;
+  result.setCoords(qMin(a.left(), b.left()), qMin(a.top(), b.top()),
+                   qMax(a.right(), b.right()), qMax(a.bottom(), b.bottom()));
+  return result;
+}
+
+
+// Sorts items by center x, cuts them into about sqrt(n / capacity)
+// vertical slices and sorts each slice by center y, so consecutive runs
+// of NODE_CAPACITY items make compact nodes.
+template <typename T>
+static void tileSort(QVector<T> &items)
+{
+  int count = items.size();
+  int nodeCount = (count + NODE_CAPACITY - 1) / NODE_CAPACITY;
+  int sliceSize = qCeil(qSqrt(nodeCount)) * NODE_CAPACITY;
+  qSort(items.begin(), items.end(), [](const T &a, const T &b) {
+    return a.bounds.center().x() < b.bounds.center().x();
+  });
+  for (int start = 0; start < count; start += sliceSize) {
+    int end = qMin(start + sliceSize, count);
+    qSort(items.begin() + start, items.begin() + end, [](const T &a, const T &b) {
+      return a.bounds.center().y() < b.bounds.center().y();
+    });
+  }
+}
+
+
+SpatialIndex::SpatialIndex()
+{
+}
+
+
+// bounds and layers are given per index; entries with inverted bounds,
+// such as references to missing structures, are left out.
+void SpatialIndex::build(const QVector<QRectF> &bounds, const QVector<int> &layers)
+{
+  _entries.clear();
+  _nodes.clear();
+  for (int i = 0; i < bounds.size(); i++) {
+    const QRectF &b = bounds.at(i);
+    if (b.left() > b.right() || b.top() > b.bottom()) {
+      continue;
+    }
+    Entry entry;
+    entry.bounds = b;
+    entry.index = i;
+    entry.layerNumber = layers.value(i, AnyLayer);
+    _entries.append(entry);
+  }
+  if (_entries.isEmpty()) {
+    return;
+  }
+
+  tileSort(_entries);
+  QVector<Node> level;
+  for (int start = 0; start < _entries.size(); start += NODE_CAPACITY) {
+    Node node;
+    node.first = start;
+    node.count = qMin(NODE_CAPACITY, _entries.size() - start);
+    node.leaf = true;
+    node.bounds = _entries.at(start).bounds;
+    for (int i = start + 1; i < start + node.count; i++) {
+      node.bounds = unite(node.bounds, _entries.at(i).bounds);
+    }
+    level.append(node);
+  }
+
+  // each level is stored before its parents; the root comes last
+  while (level.size() > 1) {
+    tileSort(level);
+    int base = _nodes.size();
+    _nodes += level;
+    QVector<Node> parents;
+    for (int start = 0; start < level.size(); start += NODE_CAPACITY) {
+      Node node;
+      node.first = base + start;
+      node.count = qMin(NODE_CAPACITY, level.size() - start);
+      node.leaf = false;
+      node.bounds = level.at(start).bounds;
+      for (int i = start + 1; i < start + node.count; i++) {
+        node.bounds = unite(node.bounds, level.at(i).bounds);
+      }
+      parents.append(node);
+    }
+    level = parents;
+  }
+  _nodes += level;
+  _entries.squeeze();
+  _nodes.squeeze();
+}
+
+
+QRectF SpatialIndex::bounds() const
+{
+  return _nodes.isEmpty() ? QRectF() : _nodes.last().bounds;
+}
+
+
+// Indices of the entries whose bounds overlap rect, restricted to one
+// layer unless layerNumber is AnyLayer. Entries built without a layer
+// only match AnyLayer.
+QVector<int> SpatialIndex::query(const QRectF &rect, int layerNumber) const
+{
+  QVector<int> result;
+  if (_nodes.isEmpty()) {
+    return result;
+  }
+  QVarLengthArray<int, 64> stack;
+  stack.append(_nodes.size() - 1);
+  while (! stack.isEmpty()) {
+    int current = stack.last();
+    stack.removeLast();
+    const Node &node = _nodes.at(current);
+    if (! overlaps(node.bounds, rect)) {
+      continue;
+    }
+    for (int i = node.first; i < node.first + node.count; i++) {
+      if (! node.leaf) {
+        stack.append(i);
+        continue;
+      }
+      const Entry &entry = _entries.at(i);
+      if ((layerNumber == AnyLayer || entry.layerNumber == layerNumber)
+          && overlaps(entry.bounds, rect)) {
+        result.append(entry.index);
+      }
+    }
+  }
+  qSort(result);
+  return result;
+}
+
+
+QVector<int> SpatialIndex::queryPoint(const QPointF &point, int layerNumber) const
+{
+  return query(QRectF(point, QSizeF(0, 0)), layerNumber);
+}
+
+} // namespace Gds
@@ -0,0 +1,51 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <QtCore/QRectF>
+#include <QtCore/QVector>
+
+namespace Gds {
+
+// A packed R-tree over element bounds, bulk loaded with Sort-Tile-
+// Recursive ordering. Entries are the indices given to build(); queries
+// return the matching ones in ascending order.
+class SpatialIndex
+{
+public:
+  enum { AnyLayer = -1 };
+
+  SpatialIndex();
+
+  void build(const QVector<QRectF> &bounds, const QVector<int> &layers);
+  int size() const { return _entries.size(); }
+  bool isEmpty() const { return _entries.isEmpty(); }
+  QRectF bounds() const;
+
+  QVector<int> query(const QRectF &rect, int layerNumber = AnyLayer) const;
+  QVector<int> queryPoint(const QPointF &point, int layerNumber = AnyLayer) const;
+
+private:
+  struct Entry
+  {
+    QRectF bounds;
+    int index;
+    int layerNumber;
+  };
+
+  // Children are entries first..first+count-1 for a leaf, nodes of the
+  // level below otherwise.
+  struct Node
+  {
+    QRectF bounds;
+    int first;
+    int count;
+    bool leaf;
+  };
+
+  QVector<Entry> _entries;
+  QVector<Node> _nodes;
+};
+
+} // namespace Gds
+
+#endif // SPATIALINDEX_H
@@ -21,11 +21,21 @@ void Station::tearDown()
   Library::release(_libs);
 }
 
+Library *Station::addLibrary(const QString &dbPath)
+{
+  Library *lib = new Library(dbPath);
+  _libs.append(lib);
+  return lib;
+}
+
 void Station::setActiveLibraryNamed(QString libname)
 {
   foreach (Library* lib, _libs) {
     if (lib->name() == libname) {
       _library = lib;
+      if (_library->isClose()) {
+        _library->mount();
+      }
       return;
     }
   }
@@ -17,6 +17,7 @@ public:
 
   void setup();
   void tearDown();
+  Library *addLibrary(const QString &dbPath);
 
   void setActiveLibraryNamed(QString libname);
   void setActiveStructureNamed(QString strucname);
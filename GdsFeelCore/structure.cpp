@@ -1,31 +1,191 @@
 #include <QtCore/QFile>
 #include <QtCore/QDir>
 #include <QtCore/QPointF>
+#include <QtCore/QSaveFile>
 #include <QtCore/QStringList>
-#include <QtXml>
-#include <QDomDocument>
+#include <QtCore/QScopedPointer>
+#include <QtCore/QXmlStreamReader>
+#include <QtCore/QXmlStreamWriter>
+#include <zlib.h>
 
 #include "structure.h"
 #include "library.h"
 #include "element.h"
+#include "structurecache.h"
+#include "elementstore.h"
+#include "spatialindex.h"
+#include "geometrycache.h"
+#include "hierarchy.h"
 
 namespace Gds {
 
 
+StructureHeader::StructureHeader()
+{
+  elementCount = 0;
+  vertexCount = 0;
+  primitiveCount = 0;
+}
+
+
+void StructureHeader::add(Element *element)
+{
+  elementCount++;
+  vertexCount += element->vertices().size();
+  PrimitiveElement *primitive = qobject_cast<PrimitiveElement *>(element);
+  if (primitive != nullptr) {
+    addPrimitive(primitive->layerNumber(), primitive->dataBounds());
+    return;
+  }
+  Sref *sref = qobject_cast<Sref *>(element);
+  if (sref == nullptr) {
+    return;
+  }
+  ReferenceInstance instance;
+  instance.structureName = sref->referenceName();
+  Aref *aref = qobject_cast<Aref *>(element);
+  if (aref != nullptr) {
+    instance.transforms = aref->transforms();
+  }
+  else {
+    instance.transforms.append(sref->transform());
+  }
+  references.append(instance);
+}
+
+
+// Counts a primitive's layer and bounds; element and vertex counts are
+// left to the caller.
+void StructureHeader::addPrimitive(int layerNumber, const QRectF &bounds)
+{
+  layerCounts[layerNumber]++;
+  if (primitiveCount == 0) {
+    primitiveBounds = bounds;
+  }
+  else {
+    primitiveBounds.setCoords(qMin(primitiveBounds.left(), bounds.left()),
+                              qMin(primitiveBounds.top(), bounds.top()),
+                              qMax(primitiveBounds.right(), bounds.right()),
+                              qMax(primitiveBounds.bottom(), bounds.bottom()));
+  }
+  primitiveCount++;
+}
+
+
+QStringList StructureHeader::referenceNames() const
+{
+  QStringList result;
+  foreach (const ReferenceInstance &instance, references) {
+    if (! result.contains(instance.structureName)) {
+      result.append(instance.structureName);
+    }
+  }
+  return result;
+}
+
+
+const qreal MAX_VAL = 32767;
+
+// Bounds of the primitives plus every placement of each referenced
+// structure whose bounds are given. Each AREF placement counts, not only
+// the first one.
+QRectF StructureHeader::bounds(const QHash<QString, QRectF> &referenceBounds) const
+{
+  qreal xmin = MAX_VAL;
+  qreal xmax = -MAX_VAL;
+  qreal ymin = MAX_VAL;
+  qreal ymax = -MAX_VAL;
+  QList<QPointF> points;
+  if (primitiveCount > 0) {
+    Element::calcOutlinePoints(primitiveBounds, points);
+  }
+  foreach (const ReferenceInstance &instance, references) {
+    if (! referenceBounds.contains(instance.structureName)) continue;
+    QList<QPointF> corners;
+    Element::calcOutlinePoints(referenceBounds.value(instance.structureName), corners);
+    foreach (const QMatrix &mat, instance.transforms) {
+      foreach (QPointF p, corners) {
+        points.append(mat.map(p));
+      }
+    }
+  }
+  foreach (QPointF p, points) {
+    if (p.x() < xmin) xmin = p.x();
+    if (p.x() > xmax) xmax = p.x();
+    if (p.y() < ymin) ymin = p.y();
+    if (p.y() > ymax) ymax = p.y();
+  }
+  QRectF result;
+  result.setCoords(xmin, ymin, xmax, ymax);
+  return result;
+}
+
+
+// Counted from the store's arrays; references give their placements
+// through the views, so no element is built.
+StructureHeader StructureHeader::fromStore(const ElementStore &store)
+{
+  StructureHeader header;
+  for (int i = 0; i < store.size(); i++) {
+    ElementView view = store.at(i);
+    header.elementCount++;
+    header.vertexCount += view.vertexCount();
+    if (view.isPrimitive()) {
+      header.addPrimitive(view.layerNumber(), view.dataBounds());
+    }
+    else if (view.isReference()) {
+      ReferenceInstance instance;
+      instance.structureName = view.referenceName();
+      instance.transforms = view.transforms();
+      header.references.append(instance);
+    }
+  }
+  return header;
+}
+
+
+StructureSummary::StructureSummary()
+{
+  generation = -1;
+  elementCount = 0;
+  vertexCount = 0;
+}
+
+
 Structure::Structure(const QFileInfo &storage)
 {
   Q_ASSERT(storage.isDir());
   _storage = storage;
   _numbers = generationNumbers();
   _dirty = false;
-  _loaded = false;
   _dataBounds = 0;
+  _header = 0;
+  _summary = 0;
+  _store = 0;
+  _spatialIndex = 0;
+}
+
+
+// Takes the generation numbers the library collected in its own scan,
+// so no directory is listed per structure. Mounted libraries have no
+// directory to list at all.
+Structure::Structure(const QFileInfo &storage, const QList<int> &numbers)
+{
+  _storage = storage;
+  _numbers = numbers;
+  _dirty = false;
+  _dataBounds = 0;
+  _header = 0;
+  _summary = 0;
+  _store = 0;
+  _spatialIndex = 0;
 }
 
 
 Structure::~Structure()
 {
   clearGeometryCache();
+  clearElements();
 }
 
 
@@ -35,8 +195,13 @@ Library *Structure::library()
 }
 
 
+// The file of the newest generation; none for a structure that has
+// not been stored yet.
 QFileInfo Structure::currentFile() const
 {
+  if (_numbers.isEmpty()) {
+    return QFileInfo();
+  }
   int maxNumber = _numbers.last();
   QString num;
   num.setNum(maxNumber);
@@ -47,6 +212,12 @@ QFileInfo Structure::currentFile() const
 }
 
 
+QString Structure::memberPath(const QFileInfo &info) const
+{
+  return _storage.fileName() + "/" + info.fileName();
+}
+
+
 QFileInfo Structure::layersFileInfo() const
 {
   QDir dir(_storage.absoluteFilePath());
@@ -62,10 +233,8 @@ QList<int> Structure::generationNumbers() const
   filters << "*.*.gdsfeelbeta";
   QStringList names = dir.entryList(filters, QDir::Files);
   foreach (QString name, names) {
-    QString genStr = name.split(".").at(1);
-    bool ok;
-    int num = genStr.toInt(&ok);
-    if (ok)
+    int num = generationNumberOf(name);
+    if (num >= 0)
       numbers.push_back(num);
   }
   qSort(numbers);
@@ -73,28 +242,282 @@ QList<int> Structure::generationNumbers() const
 }
 
 
+int Structure::generationNumberOf(const QString &fileName)
+{
+  QStringList items = fileName.split(".");
+  if (items.size() < 3 || items.last() != "gdsfeelbeta")
+    return -1;
+  bool ok;
+  int num = items.at(1).toInt(&ok);
+  return ok ? num : -1;
+}
+
+
+int Structure::generation() const
+{
+  return _numbers.isEmpty() ? -1 : _numbers.last();
+}
+
+
 QString Structure::name() const
 {
   return _storage.completeBaseName().toUpper();
 }
 
 
-QList<Element*> Structure::elements()
+// The elements in file order, as views on the flat arrays the structure
+// keeps them in. Loading builds no element objects; elementAt() makes
+// one for an element that is to be edited.
+const ElementStore &Structure::elements()
+{
+  ensureLoaded();
+  return *_store;
+}
+
+
+// Indices into elements() of the boundaries and paths, in file order.
+const QVector<int> &Structure::primitives()
+{
+  ensureLoaded();
+  return _primitives;
+}
+
+
+const QVector<int> &Structure::srefs()
+{
+  ensureLoaded();
+  return _srefs;
+}
+
+
+const QVector<int> &Structure::arefs()
+{
+  ensureLoaded();
+  return _arefs;
+}
+
+
+// Indices into elements() of the primitives on each layer and
+// datatype, in file order; the map iterates layers in ascending order.
+const QMap<LayerKey, QVector<int> > &Structure::layerBuckets()
+{
+  ensureLoaded();
+  return _layerBuckets;
+}
+
+
+QVector<int> Structure::elementsOnLayer(int layerNumber, int datatype)
+{
+  return layerBuckets().value(LayerKey(layerNumber, datatype));
+}
+
+
+// R-tree over the bounds of elements(), built on first use; entries
+// are indices into elements(). Primitives are indexed with their layer
+// number, references without one.
+const SpatialIndex &Structure::spatialIndex()
+{
+  ensureLoaded();
+  if (_spatialIndex == nullptr) {
+    QVector<QRectF> bounds;
+    QVector<int> layers;
+    bounds.reserve(_store->size());
+    layers.reserve(_store->size());
+    for (int i = 0; i < _store->size(); i++) {
+      ElementView view = _store->at(i);
+      if (view.isPrimitive()) {
+        bounds.append(view.dataBounds());
+        layers.append(view.layerNumber());
+      }
+      else {
+        bounds.append(referenceBounds(view));
+        layers.append(SpatialIndex::AnyLayer);
+      }
+    }
+    _spatialIndex = new SpatialIndex;
+    _spatialIndex->build(bounds, layers);
+  }
+  return *_spatialIndex;
+}
+
+
+// Bounds of a stored reference over all its placements, the same as
+// dataBounds() of the Sref or Aref it stands for.
+QRectF Structure::referenceBounds(const ElementView &view)
+{
+  QRectF bounds;
+  Element::resetToSmallBounds(bounds);
+  Structure *ref = library() ? library()->structureNamed(view.referenceName()) : 0;
+  if (ref == nullptr) {
+    return bounds;
+  }
+  QList<QPointF> corners;
+  Element::calcOutlinePoints(ref->dataBounds(), corners);
+  QList<int> rows;
+  rows << 0 << qMax(0, view.rowCount() - 1);
+  QList<int> columns;
+  columns << 0 << qMax(0, view.columnCount() - 1);
+  QList<QPointF> points;
+  foreach (int ri, rows) {
+    foreach (int ci, columns) {
+      QMatrix mat = view.transform();
+      mat.translate(ci * view.columnStep(), ri * view.rowStep());
+      foreach (QPointF p, corners) {
+        points.append(mat.map(p));
+      }
+    }
+  }
+  Element::calcDataBounds(points, bounds);
+  return bounds;
+}
+
+
+// An Element object for entry index, to be edited. It is a copy that
+// the caller owns: changes reach the structure through
+// replaceElement(). The object is parented to the structure only so
+// that references can find their library.
+Element *Structure::elementAt(int index)
+{
+  ensureLoaded();
+  if (index < 0 || index >= _store->size()) {
+    return 0;
+  }
+  Element *elm = _store->materialize(index);
+  if (elm != nullptr) {
+    elm->setParent(this);
+  }
+  return elm;
+}
+
+
+// Appends the data of element; the caller keeps element. Everything
+// derived from the elements is dropped, to be computed again on demand.
+void Structure::addElement(const Element *element)
+{
+  ensureLoaded();
+  _store->append(element);
+  indexElement(_store->size() - 1);
+  elementsChanged();
+}
+
+
+// Writes an element from elementAt() back to entry index; the caller
+// keeps element.
+void Structure::replaceElement(int index, const Element *element)
+{
+  ensureLoaded();
+  if (index < 0 || index >= _store->size()) {
+    return;
+  }
+  _store->replace(index, element);
+  rebuildIndexes();
+  elementsChanged();
+}
+
+
+// Entries after index move down by one.
+void Structure::removeElement(int index)
+{
+  ensureLoaded();
+  if (index < 0 || index >= _store->size()) {
+    return;
+  }
+  _store->remove(index);
+  rebuildIndexes();
+  elementsChanged();
+}
+
+
+// Drops what was derived from the elements after an edit, here and in
+// every structure that places this one, directly or not, and tells the
+// geometry cache the new cost.
+void Structure::elementsChanged()
+{
+  clearGeometryCache();
+  delete _spatialIndex;
+  _spatialIndex = 0;
+  _dirty = true;
+  if (library() == nullptr) {
+    return;
+  }
+  library()->geometryCache()->resize(this);
+  Hierarchy hierarchy(library());
+  QStringList ancestors = hierarchy.parents(name());
+  for (int i = 0; i < ancestors.size(); i++) {
+    Structure *ancestor = library()->structureNamed(ancestors.at(i));
+    if (ancestor != nullptr) {
+      ancestor->resetDataBounds();
+    }
+    foreach (QString parent, hierarchy.parents(ancestors.at(i))) {
+      if (! ancestors.contains(parent)) {
+        ancestors.append(parent);
+      }
+    }
+  }
+}
+
+
+// Adds entry index of the store to the kind and layer views.
+void Structure::indexElement(int index)
+{
+  ElementView view = _store->at(index);
+  switch (view.kind()) {
+  case Element::BoundaryKind:
+  case Element::PathKind:
+    _primitives.append(index);
+    _layerBuckets[LayerKey(view.layerNumber(), view.datatype())].append(index);
+    break;
+  case Element::SrefKind:
+    _srefs.append(index);
+    break;
+  case Element::ArefKind:
+    _arefs.append(index);
+    break;
+  default:
+    break;
+  }
+}
+
+
+// Drops the store and the views on it.
+void Structure::clearElements()
 {
-  load();
-  return this->findChildren<Element*>();
+  delete _store;
+  _store = 0;
+  _primitives.clear();
+  _srefs.clear();
+  _arefs.clear();
+  _layerBuckets.clear();
+  delete _spatialIndex;
+  _spatialIndex = 0;
+}
+
+
+// Replacing or removing an entry can shift the indices after it, so
+// the views are filled again.
+void Structure::rebuildIndexes()
+{
+  _primitives.clear();
+  _srefs.clear();
+  _arefs.clear();
+  _layerBuckets.clear();
+  for (int i = 0; i < _store->size(); i++) {
+    indexElement(i);
+  }
 }
 
 
 void Structure::clearGeometryCache()
 {
-  free(_dataBounds);
+  delete _dataBounds;
   _dataBounds = 0;
+  delete _header;
+  _header = 0;
+  delete _summary;
+  _summary = 0;
 }
 
 
-const qreal MAX_VAL = 32767;
-
 QRectF Structure::dataBounds()
 {
   // FIXME: duplicate implement Element
@@ -107,81 +530,361 @@ QRectF Structure::dataBounds()
 }
 
 
+// The summary of the current generation: the one read from LIB.ini if
+// it still matches, otherwise built from the header.
+StructureSummary Structure::summary()
+{
+  if (_summary == nullptr || _summary->generation != generation()) {
+    const StructureHeader &h = header();
+    StructureSummary summary;
+    summary.generation = generation();
+    summary.bounds = dataBounds();
+    summary.elementCount = h.elementCount;
+    summary.vertexCount = h.vertexCount;
+    summary.layers = h.layerCounts.keys();
+    summary.references = h.referenceNames();
+    setSummary(summary);
+  }
+  return *_summary;
+}
+
+
+// Takes a summary of the current generation and its bounds, so they
+// are answered without reading the header.
+void Structure::setSummary(const StructureSummary &summary)
+{
+  if (summary.generation != generation()) {
+    return;
+  }
+  if (_summary == nullptr) {
+    _summary = new StructureSummary;
+  }
+  *_summary = summary;
+  setDataBounds(summary.bounds);
+}
+
+
+// Forgets bounds, summary and the spatial index, which hold the bounds
+// of references, but keeps the header, for when a referenced structure
+// changed.
+void Structure::resetDataBounds()
+{
+  delete _dataBounds;
+  _dataBounds = 0;
+  delete _summary;
+  _summary = 0;
+  delete _spatialIndex;
+  _spatialIndex = 0;
+}
+
+
+// Lets Hierarchy hand in bounds it computed for the whole library.
+void Structure::setDataBounds(const QRectF &bounds)
+{
+  if (_dataBounds == nullptr) {
+    _dataBounds = new QRectF;
+  }
+  *_dataBounds = bounds;
+}
+
+
+// Answers the header without loading the elements when they are not
+// loaded yet: it comes from the sidecar cache if there is one, otherwise
+// the generation is parsed once and the elements are dropped again.
+const StructureHeader &Structure::header()
+{
+  if (_header == nullptr) {
+    _header = new StructureHeader;
+    if (_store != nullptr) {
+      *_header = StructureHeader::fromStore(*_store);
+    }
+    else {
+      *_header = parseHeader();
+    }
+  }
+  return *_header;
+}
+
+
+// The header of the current generation from the sidecar cache, or else
+// from parsing it. Nothing of the structure is changed, so headers of
+// unloaded structures can be parsed on worker threads; setHeader()
+// keeps the result.
+StructureHeader Structure::parseHeader()
+{
+  StructureHeader header;
+  if (! readHeader(header)) {
+    ElementStore store;
+    readStore(store);
+    header = StructureHeader::fromStore(store);
+  }
+  return header;
+}
+
+
+void Structure::setHeader(const StructureHeader &header)
+{
+  if (_header == nullptr) {
+    _header = new StructureHeader;
+  }
+  *_header = header;
+}
+
+
+// Bounds come from the header, so no geometry is loaded.
 void Structure::lookupDataBounds(QRectF &bounds)
 {
-  qreal xmin = MAX_VAL;
-  qreal xmax = -MAX_VAL;
-  qreal ymin = MAX_VAL;
-  qreal ymax = -MAX_VAL;
-  foreach (Element *e, elements()) {
-    QList<QPointF> points;
-    Element::calcOutlinePoints(e->dataBounds(), points);
-    foreach (QPointF p, points) {
-      if (p.x() < xmin) xmin = p.x();
-      if (p.x() > xmax) xmax = p.x();
-      if (p.y() < ymin) ymin = p.y();
-      if (p.y() > ymax) ymax = p.y();
+  const StructureHeader &h = header();
+  QHash<QString, QRectF> referenceBounds;
+  foreach (QString refName, h.referenceNames()) {
+    Structure *ref = library() ? library()->structureNamed(refName) : 0;
+    if (ref == nullptr) {
+      qDebug() << "structure not found: " << refName << endl;
+      continue;
     }
+    referenceBounds.insert(refName, ref->dataBounds());
   }
-  bounds.setCoords(xmin, ymin, xmax, ymax);
+  bounds = h.bounds(referenceBounds);
 }
 
 
+// Loads the elements on request. The geometry cache counts this as a
+// hit when they are already loaded and as a miss when they are read.
 void Structure::load()
 {
-  if (! _loaded) {
-    forceLoad();
-    _loaded = true;
+  if (_store != nullptr) {
+    if (library() != nullptr) {
+      library()->geometryCache()->hit(this);
+    }
+    return;
+  }
+  forceLoad();
+}
+
+
+// What the accessors call: loads the elements if needed, and otherwise
+// only marks them as used, without counting a hit.
+void Structure::ensureLoaded()
+{
+  if (_store != nullptr) {
+    if (library() != nullptr) {
+      library()->geometryCache()->touch(this);
+    }
+    return;
+  }
+  forceLoad();
+}
+
+
+// Drops the elements but keeps header, bounds and summary; the next
+// load() reads them again. Dirty structures are kept.
+bool Structure::unload()
+{
+  if (_store == nullptr || _dirty) {
+    return false;
   }
+  clearElements();
+  return true;
+}
+
+
+// Memory held by the loaded elements.
+qint64 Structure::geometryCost()
+{
+  return _store != nullptr ? _store->memoryUsage() : 0;
 }
 
 
 void Structure::forceLoad()
 {
   _dirty = false;
-//  _elements.clear();
-  // FIXME:
+  ElementStore store;
+  readStore(store);
+  adoptStore(store);
+}
+
+
+// Finds what the sidecar cache is checked against for the current
+// generation: the crc32 from the archive directory of a mounted library,
+// or else the size and time of the extracted file, which is not read.
+bool Structure::lookupCacheKey(CacheKey &key)
+{
   QFileInfo xmlInfo = currentFile();
+  if (library() != nullptr && library()->isMounted()) {
+    if (! library()->memberCrc(memberPath(xmlInfo), key.crc)) {
+      qDebug() << "Xml member not found: " << xmlInfo.fileName();
+      return false;
+    }
+    key.hasCrc = true;
+    return true;
+  }
   if (! xmlInfo.isFile()) {
     qDebug() << "Xml File not found: " << xmlInfo.fileName();
-    return;
+    return false;
   }
+  key.size = xmlInfo.size();
+  key.modified = xmlInfo.lastModified().toMSecsSinceEpoch();
+  return true;
+}
 
-  QDomDocument domDoc(name());
+
+bool Structure::readContents(QByteArray &contents)
+{
+  QFileInfo xmlInfo = currentFile();
+  if (library() != nullptr && library()->isMounted()) {
+    contents = library()->memberData(memberPath(xmlInfo));
+    return true;
+  }
   QFile xmlStorage(xmlInfo.absoluteFilePath());
   if (!xmlStorage.open(QIODevice::ReadOnly)) {
     qDebug() << "Xml File can't open" << xmlInfo.fileName();
-    return;
+    return false;
   }
-  if (!domDoc.setContent(&xmlStorage)) {
-    qDebug() << "Xml contents error" << xmlInfo.fileName();
-    xmlStorage.close();
-    return;
+  contents = xmlStorage.readAll();
+  return true;
+}
+
+
+bool Structure::readHeader(StructureHeader &header)
+{
+  if (generation() < 0) {
+    header = StructureHeader();
+    return true;
   }
-  xmlStorage.close();
+  if (library() == nullptr) {
+    return false;
+  }
+  CacheKey key;
+  if (! lookupCacheKey(key)) {
+    return false;
+  }
+  StructureCache cache(library()->name());
+  return cache.loadHeader(name(), generation(), key, header);
+}
+
 
-  QDomElement docElem = domDoc.documentElement();
-  QDomNode n = docElem.firstChild();
-  while(!n.isNull()) {
-    QDomElement e = n.toElement();
-    if(!e.isNull()) {
-//      qDebug() << qPrintable(e.tagName()) << endl;
-      if (e.tagName() != QString("element")) break;
-      Element *elm = Element::fromXmlElement(e);
+// Fills store from the sidecar cache, or else parses the current
+// generation one element at a time; each element goes into the store
+// and is deleted right away. A structure without generations has no
+// elements. Nothing of the structure is changed, so this can run on a
+// worker thread; adoptStore() takes the result on the structure's
+// thread.
+bool Structure::readStore(ElementStore &store)
+{
+  int generation = this->generation();
+  if (generation < 0) {
+    return true;
+  }
+  CacheKey key;
+  if (! lookupCacheKey(key)) {
+    return false;
+  }
+  QScopedPointer<StructureCache> cache;
+  if (library() != nullptr) {
+    cache.reset(new StructureCache(library()->name()));
+    if (cache->loadStore(name(), generation, key, store)) {
+      return true;
+    }
+  }
+  QByteArray contents;
+  if (! readContents(contents)) {
+    return false;
+  }
+  if (! key.hasCrc) {
+    // the image may still match by content, if it was written from the
+    // archive or before the file was touched; it is written again so
+    // the next lookup matches by size and time
+    key.crc = ::crc32(::crc32(0L, Z_NULL, 0),
+                      reinterpret_cast<const Bytef *>(contents.constData()),
+                      contents.size());
+    key.hasCrc = true;
+    if (cache && cache->loadStore(name(), generation, key, store)) {
+      cache->store(name(), generation, key, store);
+      return true;
+    }
+  }
+  QXmlStreamReader reader(contents);
+  if (reader.readNextStartElement()) {
+    while (reader.readNextStartElement()) {
+      if (reader.name() != QLatin1String("element")) break;
+      Element *elm = Element::fromXmlStream(reader);
       if (elm != 0) {
-         elm->setParent(this);
-//        _elements.append(elm);
+        store.append(elm);
+        delete elm;
       }
     }
-    n = n.nextSibling();
+  }
+  if (reader.hasError()) {
+    qDebug() << "Xml contents error" << currentFile().fileName() << reader.errorString();
+    return false;
+  }
+  if (cache) {
+    cache->store(name(), generation, key, store);
+  }
+  return true;
+}
+
+
+// Takes a store from readStore() as the loaded elements. A structure
+// that got loaded meanwhile keeps what it has.
+void Structure::adoptStore(const ElementStore &store)
+{
+  if (_store != nullptr) {
+    return;
+  }
+  _store = new ElementStore(store);
+  _store->squeeze();
+  rebuildIndexes();
+  if (library() != nullptr) {
+    library()->geometryCache()->admit(this);
   }
 }
 
 
+// Writes the loaded elements as a new generation next to the previous
+// ones. Elements are built and streamed into the file one at a time, so
+// nothing but the writer's buffer is held besides the store.
 void Structure::store()
 {
-  // FIXME:
+  if (_store == nullptr) {
+    _dirty = false;
+    return;
+  }
+  if (library() != nullptr && library()->isMounted()) {
+    qDebug() << "can't store into a mounted library: " << name();
+    return;
+  }
+  int number = _numbers.isEmpty() ? 1 : _numbers.last() + 1;
+  QStringList items;
+  items << name() << QString::number(number) << "gdsfeelbeta";
+  QDir dir(_storage.absoluteFilePath());
+  QSaveFile xmlStorage(dir.absoluteFilePath(items.join(".")));
+  if (! xmlStorage.open(QIODevice::WriteOnly)) {
+    qDebug() << "Xml File can't open" << xmlStorage.fileName();
+    return;
+  }
+  QXmlStreamWriter writer(&xmlStorage);
+  writer.setAutoFormatting(true);
+  writer.writeStartDocument();
+  writer.writeStartElement("structure");
+  writer.writeAttribute("name", name());
+  for (int i = 0; i < _store->size(); i++) {
+    QScopedPointer<Element> elm(_store->materialize(i));
+    if (! elm.isNull()) {
+      elm->toXmlStream(writer);
+    }
+  }
+  writer.writeEndElement();
+  writer.writeEndDocument();
+  if (writer.hasError() || ! xmlStorage.commit()) {
+    qDebug() << "Xml File can't write" << xmlStorage.fileName();
+    return;
+  }
+  _numbers.append(number);
   _dirty = false;
+  if (library() != nullptr) {
+    library()->memberWritten(memberPath(QFileInfo(xmlStorage.fileName())));
+  }
 }
 
 
@@ -191,4 +894,10 @@ bool Structure::isDirty() const
 }
 
 
+bool Structure::isLoaded() const
+{
+  return _store != nullptr;
+}
+
+
 } // namespace Gds
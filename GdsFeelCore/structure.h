@@ -3,11 +3,72 @@
 
 #include <QtCore/QFileInfo>
 #include <QtCore/QRectF>
+#include <QtCore/QMap>
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+#include <QtCore/QPair>
+#include <QtCore/QVector>
+#include <QMatrix>
 
 namespace Gds {
 
 class Library;
 class Element;
+class ElementStore;
+struct CacheKey;
+class ElementView;
+class SpatialIndex;
+
+
+struct ReferenceInstance
+{
+  QString structureName;
+  QList<QMatrix> transforms;
+};
+
+
+// What a structure holds, without its geometry: the bounds of its own
+// primitives, element counts per layer and the placements of the
+// structures it references.
+class StructureHeader
+{
+public:
+  StructureHeader();
+
+  void add(Element *element);
+  void addPrimitive(int layerNumber, const QRectF &bounds);
+  QStringList referenceNames() const;
+  QRectF bounds(const QHash<QString, QRectF> &referenceBounds) const;
+
+  static StructureHeader fromStore(const ElementStore &store);
+
+  int elementCount;
+  int vertexCount;
+  int primitiveCount;
+  QRectF primitiveBounds;
+  QMap<int, int> layerCounts;
+  QList<ReferenceInstance> references;
+};
+
+
+// Persisted form of a structure's header and bounds, kept per
+// generation in LIB.ini so it is known before anything is loaded.
+struct StructureSummary
+{
+  StructureSummary();
+
+  int generation;
+  QRectF bounds;
+  int elementCount;
+  int vertexCount;
+  QList<int> layers;
+  QStringList references;
+};
+
+
+// Layer number and datatype of a primitive.
+typedef QPair<int, int> LayerKey;
+
 
 class Structure : public QObject
 {
@@ -15,33 +76,77 @@ class Structure : public QObject
 
 public:
   Structure(const QFileInfo &storage);
+  Structure(const QFileInfo &storage, const QList<int> &numbers);
   ~Structure();
 
   Library *library();
 
   QString name() const;
+  int generation() const;
   bool isDirty() const;
+  bool isLoaded() const;
   void load();
-  QList<Element*> elements();
+  bool unload();
+  qint64 geometryCost();
+  bool readStore(ElementStore &store);
+  void adoptStore(const ElementStore &store);
+  void store();
+  const ElementStore &elements();
+  const QVector<int> &primitives();
+  const QVector<int> &srefs();
+  const QVector<int> &arefs();
+  const QMap<LayerKey, QVector<int> > &layerBuckets();
+  QVector<int> elementsOnLayer(int layerNumber, int datatype);
+  const SpatialIndex &spatialIndex();
+  Element *elementAt(int index);
+  void addElement(const Element *element);
+  void replaceElement(int index, const Element *element);
+  void removeElement(int index);
+  const StructureHeader &header();
+  bool hasHeader() const { return _header != nullptr; }
+  StructureHeader parseHeader();
+  void setHeader(const StructureHeader &header);
   QRectF dataBounds();
+  void setDataBounds(const QRectF &bounds);
+  void resetDataBounds();
+  StructureSummary summary();
+  void setSummary(const StructureSummary &summary);
+
+  static int generationNumberOf(const QString &fileName);
 
 protected:
   void forceLoad();
 
 private:
+  void ensureLoaded();
   QList<int> generationNumbers() const;
-  void store();
   QFileInfo currentFile() const;
+  bool lookupCacheKey(CacheKey &key);
+  bool readContents(QByteArray &contents);
+  bool readHeader(StructureHeader &header);
+  QString memberPath(const QFileInfo &info) const;
   QFileInfo layersFileInfo() const;
   void clearGeometryCache();
+  void indexElement(int index);
+  void clearElements();
+  void rebuildIndexes();
+  void elementsChanged();
+  QRectF referenceBounds(const ElementView &view);
   void lookupDataBounds(QRectF &bounds);
 
 private:
   QFileInfo _storage;
   QList<int>  _numbers;
   bool _dirty;
-  bool _loaded;
   QRectF *_dataBounds;
+  StructureHeader *_header;
+  StructureSummary *_summary;
+  ElementStore *_store;
+  SpatialIndex *_spatialIndex;
+  QVector<int> _primitives;
+  QVector<int> _srefs;
+  QVector<int> _arefs;
+  QMap<LayerKey, QVector<int> > _layerBuckets;
 
 };
 
@@ -0,0 +1,271 @@
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QRegExp>
+#include <QtCore/QSaveFile>
+#include <QtCore/QVector>
+#include <string.h>
+
+#include "structurecache.h"
+#include "structure.h"
+#include "element.h"
+#include "elementstore.h"
+#include "config.h"
+
+namespace Gds {
+
+const quint32 CACHE_MAGIC = 0x43534647; // "GFSC" little endian
+const quint32 CACHE_VERSION = 3;
+
+// Layout: header, ElementRecord[elementCount], double[coordinateCount],
+// then nameLength UTF-16 code units. Every part starts 8-byte aligned,
+// so the mapped file is read in place. The header also carries the
+// bounds of the primitives, which StructureHeader can not recompute
+// from the records without building the path outlines. sourceSize and
+// sourceModified are -1 when the image was written from an archive.
+struct CacheHeader
+{
+  quint32 magic;
+  quint32 version;
+  quint32 crc;
+  quint32 elementCount;
+  quint32 coordinateCount;
+  quint32 nameLength;
+  quint32 recordSize;
+  quint32 primitiveCount;
+  double primitiveBounds[4];
+  qint64 sourceSize;
+  qint64 sourceModified;
+};
+
+
+CacheKey::CacheKey()
+{
+  hasCrc = false;
+  crc = 0;
+  size = -1;
+  modified = -1;
+}
+
+
+// A key with a crc is matched on it alone; otherwise size and time of a
+// file have to match.
+static bool matches(const CacheHeader *header, const CacheKey &key)
+{
+  if (key.hasCrc) {
+    return header->crc == key.crc;
+  }
+  return key.size >= 0
+      && header->sourceSize == key.size
+      && header->sourceModified == key.modified;
+}
+
+
+// A validated view on a mapped cache file.
+struct CacheImage
+{
+  const CacheHeader *header;
+  const ElementRecord *records;
+  const double *coordinates;
+  const QChar *names;
+
+  bool map(QFile &file, const CacheKey &key);
+  bool isValid(quint32 index) const;
+  Element *elementAt(quint32 index) const;
+};
+
+
+bool CacheImage::map(QFile &file, const CacheKey &key)
+{
+  if (! file.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+  qint64 size = file.size();
+  if (size < (qint64) sizeof(CacheHeader)) {
+    return false;
+  }
+  const uchar *data = file.map(0, size);
+  if (data == 0) {
+    return false;
+  }
+  header = reinterpret_cast<const CacheHeader *>(data);
+  if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION
+      || ! matches(header, key) || header->recordSize != sizeof(ElementRecord)) {
+    return false;
+  }
+  qint64 recordsSize = (qint64) header->elementCount * sizeof(ElementRecord);
+  qint64 coordinatesSize = (qint64) header->coordinateCount * sizeof(double);
+  qint64 namesSize = (qint64) header->nameLength * sizeof(QChar);
+  if (size != (qint64) sizeof(CacheHeader) + recordsSize + coordinatesSize + namesSize) {
+    qDebug() << "broken structure cache: " << file.fileName();
+    return false;
+  }
+  records = reinterpret_cast<const ElementRecord *>(data + sizeof(CacheHeader));
+  coordinates = reinterpret_cast<const double *>(data + sizeof(CacheHeader) + recordsSize);
+  names = reinterpret_cast<const QChar *>(data + sizeof(CacheHeader) + recordsSize + coordinatesSize);
+  return true;
+}
+
+
+// Whether the record's vertices and name lie inside the image.
+bool CacheImage::isValid(quint32 index) const
+{
+  const ElementRecord &record = records[index];
+  return (quint64) record.firstCoordinate + 2 * (quint64) record.vertexCount <= header->coordinateCount
+      && (quint64) record.nameOffset + record.nameLength <= header->nameLength;
+}
+
+
+Element *CacheImage::elementAt(quint32 index) const
+{
+  if (! isValid(index)) {
+    return 0;
+  }
+  const ElementRecord &record = records[index];
+  QString name(names + record.nameOffset, record.nameLength);
+  return Element::fromRecord(record, name, coordinates + record.firstCoordinate);
+}
+
+
+StructureCache::StructureCache(const QString &libraryName)
+{
+  _dir = QDir(QDir(Config::pathToCache()).absoluteFilePath(libraryName));
+}
+
+
+QString StructureCache::pathFor(const QString &structureName, int generation) const
+{
+  return _dir.absoluteFilePath(QString("%1.%2.cache").arg(structureName).arg(generation));
+}
+
+
+// Appends the records to store as they are; no element is built.
+bool StructureCache::loadStore(const QString &structureName, int generation, const CacheKey &key,
+                               ElementStore &store)
+{
+  QFile file(pathFor(structureName, generation));
+  CacheImage image;
+  if (! image.map(file, key)) {
+    return false;
+  }
+  ElementStore restored;
+  for (quint32 i = 0; i < image.header->elementCount; i++) {
+    if (! image.isValid(i)) {
+      qDebug() << "broken structure cache: " << file.fileName();
+      return false;
+    }
+    const ElementRecord &record = image.records[i];
+    QString name(image.names + record.nameOffset, record.nameLength);
+    restored.append(record, name, image.coordinates + record.firstCoordinate);
+  }
+  store = restored;
+  return true;
+}
+
+
+// Fills header from the records alone; only reference elements are
+// built, to get their placements.
+bool StructureCache::loadHeader(const QString &structureName, int generation, const CacheKey &key,
+                                StructureHeader &header)
+{
+  QFile file(pathFor(structureName, generation));
+  CacheImage image;
+  if (! image.map(file, key)) {
+    return false;
+  }
+  StructureHeader result;
+  for (quint32 i = 0; i < image.header->elementCount; i++) {
+    const ElementRecord &record = image.records[i];
+    if (record.kind == Element::BoundaryKind || record.kind == Element::PathKind) {
+      result.elementCount++;
+      result.vertexCount += record.vertexCount;
+      result.layerCounts[record.layerNumber]++;
+      continue;
+    }
+    Element *elm = image.elementAt(i);
+    if (elm == nullptr) {
+      qDebug() << "broken structure cache: " << file.fileName();
+      return false;
+    }
+    result.add(elm);
+    delete elm;
+  }
+  const double *b = image.header->primitiveBounds;
+  result.primitiveCount = image.header->primitiveCount;
+  result.primitiveBounds.setCoords(b[0], b[1], b[2], b[3]);
+  header = result;
+  return true;
+}
+
+
+// The store's coordinate buffer is written as it is, so records keep
+// their offsets into it.
+void StructureCache::store(const QString &structureName, int generation, const CacheKey &key,
+                           const ElementStore &store)
+{
+  if (! _dir.exists() && ! _dir.mkpath(".")) {
+    return;
+  }
+  QVector<ElementRecord> records;
+  const QVector<double> &coordinates = store.coordinates();
+  QString names;
+  records.reserve(store.size());
+  for (int i = 0; i < store.size(); i++) {
+    QString name;
+    ElementRecord record = store.recordAt(i, name);
+    record.nameOffset = names.size();
+    record.nameLength = name.size();
+    names.append(name);
+    records.append(record);
+  }
+
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = CACHE_MAGIC;
+  header.version = CACHE_VERSION;
+  header.crc = key.crc;
+  header.sourceSize = key.size;
+  header.sourceModified = key.modified;
+  header.elementCount = records.size();
+  header.coordinateCount = coordinates.size();
+  header.nameLength = names.size();
+  header.recordSize = sizeof(ElementRecord);
+  StructureHeader summary = StructureHeader::fromStore(store);
+  header.primitiveCount = summary.primitiveCount;
+  qreal x1, y1, x2, y2;
+  summary.primitiveBounds.getCoords(&x1, &y1, &x2, &y2);
+  header.primitiveBounds[0] = x1;
+  header.primitiveBounds[1] = y1;
+  header.primitiveBounds[2] = x2;
+  header.primitiveBounds[3] = y2;
+
+  QSaveFile file(pathFor(structureName, generation));
+  if (! file.open(QIODevice::WriteOnly)) {
+    return;
+  }
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char *>(records.constData()),
+             records.size() * sizeof(ElementRecord));
+  file.write(reinterpret_cast<const char *>(coordinates.constData()),
+             coordinates.size() * sizeof(double));
+  file.write(reinterpret_cast<const char *>(names.constData()),
+             names.size() * sizeof(QChar));
+  if (! file.commit()) {
+    qDebug() << "can't write structure cache: " << file.fileName();
+    return;
+  }
+
+  // older generations of the same structure are not needed any more;
+  // the glob also matches structures named like "NAME.OTHER", so the
+  // generation field is checked to be a number
+  QStringList filters;
+  filters << structureName + ".*.cache";
+  QRegExp generationPattern(QRegExp::escape(structureName) + "\\.\\d+\\.cache");
+  QString current = QFileInfo(file.fileName()).fileName();
+  foreach (QString stale, _dir.entryList(filters, QDir::Files)) {
+    if (stale != current && generationPattern.exactMatch(stale)) {
+      _dir.remove(stale);
+    }
+  }
+}
+
+} // namespace Gds
@@ -0,0 +1,50 @@
+#ifndef STRUCTURECACHE_H
+#define STRUCTURECACHE_H
+
+#include <QtCore/QDir>
+
+namespace Gds {
+
+class ElementStore;
+class StructureHeader;
+
+// What an image is checked against. A mounted library knows the crc32
+// of a generation file from the archive directory. For an extracted one
+// the file's size and modification time are compared instead, so the
+// file is only read when they do not match.
+struct CacheKey
+{
+  CacheKey();
+
+  bool hasCrc;
+  quint32 crc;
+  qint64 size;
+  qint64 modified;
+};
+
+
+// Keeps a flat binary image of each parsed structure generation, so a
+// structure whose XML did not change is restored without parsing.
+// Images are keyed by structure name and generation number, and checked
+// against a CacheKey of the generation file.
+class StructureCache
+{
+public:
+  StructureCache(const QString &libraryName);
+
+  bool loadStore(const QString &structureName, int generation, const CacheKey &key,
+                 ElementStore &store);
+  bool loadHeader(const QString &structureName, int generation, const CacheKey &key,
+                  StructureHeader &header);
+  void store(const QString &structureName, int generation, const CacheKey &key,
+             const ElementStore &store);
+
+private:
+  QString pathFor(const QString &structureName, int generation) const;
+
+  QDir _dir;
+};
+
+} // namespace Gds
+
+#endif // STRUCTURECACHE_H
@@ -2,6 +2,17 @@
 #include <QtCore/QObject>
 #include <QtCore/QList>
 #include "../GdsFeelCore/library.h"
+#include "../GdsFeelCore/structure.h"
+#include "../GdsFeelCore/hierarchy.h"
+#include "../GdsFeelCore/geometrycache.h"
+#include "../GdsFeelCore/elementstore.h"
+#include "../GdsFeelCore/element.h"
+#include "../GdsFeelCore/spatialindex.h"
+#include "../GdsFeelCore/regionquery.h"
+#include "../GdsFeelCore/structurecache.h"
+#include "../GdsFeelCore/config.h"
+#include "../GdsFeelCore/qzipreader_p.h"
+#include "../GdsFeelCore/qzipwriter_p.h"
 
 using namespace Gds;
 
@@ -12,6 +23,27 @@ class TestLibrary : public QObject
 private slots:
   void files();
   void open_close();
+  void mount_close();
+  void catalog_names();
+  void close_unmodified();
+  void preload();
+  void hierarchy();
+  void geometry_budget();
+  void element_store();
+  void element_kinds();
+  void scan_coordinates();
+  void layer_buckets();
+  void spatial_index();
+  void region_query();
+  void cache_cleanup();
+  void cache_keys();
+  void empty_structure();
+  void store_round_trip();
+  void edit_resets_parents();
+  void save_copies_untouched();
+  void zip_workers();
+  void zip64_fixture();
+  void zip64_round_trip();
 };
 
 void TestLibrary::files()
@@ -39,5 +71,847 @@ void TestLibrary::open_close()
   }
 }
 
+void TestLibrary::mount_close()
+{
+  QList<Library*> libs = Library::availables();
+  QVERIFY(libs.size() > 0);
+  foreach (Library* lib, libs) {
+    qDebug() << lib->name();
+    QBENCHMARK {
+      lib->mount();
+      lib->close();
+    }
+    lib->mount();
+    QVERIFY(lib->isMounted());
+    QVERIFY(lib->isOpen());
+    QCOMPARE(lib->structures().size(), lib->structureNames().size());
+    lib->close();
+    QVERIFY(lib->isClose());
+  }
+  Library::release(libs);
+}
+
+// A closed library answers from the catalog what mounting it reads.
+void TestLibrary::catalog_names()
+{
+  QList<Library*> libs = Library::availables();
+  QVERIFY(libs.size() > 0);
+  foreach (Library* lib, libs) {
+    QStringList names = lib->structureNames();
+    int dbu = lib->dbu();
+    QString unit = lib->unit();
+    QVERIFY(lib->isClose());
+    lib->mount();
+    QCOMPARE(lib->structureNames(), names);
+    QCOMPARE(lib->dbu(), dbu);
+    QCOMPARE(lib->unit(), unit);
+    lib->close();
+  }
+  Library::release(libs);
+}
+
+void TestLibrary::close_unmodified()
+{
+  QFileInfoList infos = Library::files();
+  QVERIFY(infos.size() > 0);
+  foreach (QFileInfo before, infos) {
+    Library lib(before.absoluteFilePath());
+    lib.open();
+    QVERIFY(! lib.isDirty());
+    lib.close();
+    QVERIFY(lib.isClose());
+    QFileInfo after(before.absoluteFilePath());
+    QCOMPARE(after.lastModified(), before.lastModified());
+    QCOMPARE(after.size(), before.size());
+  }
+}
+
+void TestLibrary::preload()
+{
+  QList<Library*> libs = Library::availables();
+  QVERIFY(libs.size() > 0);
+  foreach (Library* lib, libs) {
+    lib->mount();
+    lib->preload();
+    lib->waitForPreload();
+    QVERIFY(! lib->isPreloading());
+    foreach (Structure *s, lib->structures()) {
+      QVERIFY(s->isLoaded());
+    }
+    lib->close();
+  }
+  Library::release(libs);
+}
+
+void TestLibrary::hierarchy()
+{
+  QList<Library*> libs = Library::availables();
+  QVERIFY(libs.size() > 0);
+  foreach (Library* lib, libs) {
+    lib->mount();
+    Hierarchy hierarchy(lib);
+    QStringList order = hierarchy.topologicalOrder();
+    foreach (QString name, order) {
+      foreach (QString child, hierarchy.children(name)) {
+        QVERIFY(order.indexOf(child) < order.indexOf(name));
+      }
+    }
+    QCOMPARE(order.size() + hierarchy.cyclic().size(), lib->structures().size());
+    QHash<QString, QRectF> bounds = hierarchy.computeBounds(4);
+    foreach (QString name, order) {
+      QCOMPARE(bounds.value(name), lib->structureNamed(name)->dataBounds());
+    }
+    lib->close();
+  }
+  Library::release(libs);
+}
+
+void TestLibrary::geometry_budget()
+{
+  QList<Library*> libs = Library::availables();
+  QVERIFY(libs.size() > 0);
+  foreach (Library* lib, libs) {
+    lib->mount();
+    GeometryCache *cache = lib->geometryCache();
+    cache->setBudget(1);
+    cache->resetCounters();
+    QList<Structure*> structures = lib->structures();
+    foreach (Structure *s, structures) {
+      s->load();
+      s->load();
+    }
+    QCOMPARE(cache->misses(), structures.size());
+    QCOMPARE(cache->hits(), structures.size());
+    int loaded = 0;
+    foreach (Structure *s, structures) {
+      if (s->isLoaded()) loaded++;
+    }
+    QVERIFY(loaded <= 1);
+    QCOMPARE(cache->evictions(), structures.size() - loaded);
+
+    // accessors on loaded structures are not counted
+    cache->setBudget(Q_INT64_C(1) << 40);
+    foreach (Structure *s, structures) {
+      s->load();
+    }
+    cache->resetCounters();
+    foreach (Structure *s, structures) {
+      s->elements();
+      s->primitives();
+      s->layerBuckets();
+    }
+    QCOMPARE(cache->hits(), 0);
+    QCOMPARE(cache->misses(), 0);
+    lib->close();
+  }
+  Library::release(libs);
+}
+
+void TestLibrary::element_store()
+{
+  QList<Library*> libs = Library::availables();
+  QVERIFY(libs.size() > 0);
+  foreach (Library* lib, libs) {
+    lib->mount();
+    foreach (Structure *s, lib->structures()) {
+      const ElementStore &elements = s->elements();
+      QCOMPARE(elements.size(), s->header().elementCount);
+      for (int i = 0; i < elements.size(); i++) {
+        ElementView view = elements.at(i);
+        QScopedPointer<Element> elm(s->elementAt(i));
+        QVERIFY(! elm.isNull());
+        QCOMPARE(view.kind(), elm->kind());
+        QCOMPARE(view.vertices(), elm->vertices());
+        if (view.isPrimitive()) {
+          QCOMPARE(view.outlinePoints(), elm->outlinePoints());
+          QCOMPARE(view.dataBounds(), elm->dataBounds());
+        }
+        else if (Aref *aref = qobject_cast<Aref *>(elm.data())) {
+          QCOMPARE(view.transforms(), aref->transforms());
+        }
+        else {
+          QCOMPARE(view.transform(), qobject_cast<Sref *>(elm.data())->transform());
+        }
+      }
+      QVERIFY(! s->isDirty());
+
+      QRectF bounds = s->dataBounds();
+      QRectF window(bounds.topLeft(), bounds.size() / 2);
+      QVector<int> before = s->spatialIndex().query(window);
+      QVERIFY(s->unload());
+      QVERIFY(! s->isLoaded());
+      QCOMPARE(s->spatialIndex().query(window), before);
+    }
+    lib->close();
+  }
+  Library::release(libs);
+}
+
+void TestLibrary::element_kinds()
+{
+  QList<Library*> libs = Library::availables();
+  QVERIFY(libs.size() > 0);
+  foreach (Library* lib, libs) {
+    lib->mount();
+    QCOMPARE(lib->structures().size(), lib->structureNames().size());
+    foreach (Structure *s, lib->structures()) {
+      const ElementStore &elements = s->elements();
+      QCOMPARE(s->primitives().size() + s->srefs().size() + s->arefs().size(),
+               elements.size());
+      foreach (int index, s->primitives()) {
+        QVERIFY(elements.at(index).isPrimitive());
+      }
+      foreach (int index, s->srefs()) {
+        QCOMPARE(elements.at(index).kind(), Element::SrefKind);
+      }
+      foreach (int index, s->arefs()) {
+        QCOMPARE(elements.at(index).kind(), Element::ArefKind);
+      }
+    }
+    lib->close();
+  }
+  Library::release(libs);
+}
+
+// Reads a boundary whose vertices hold the given xy texts.
+static QList<QPointF> verticesFromXy(const QStringList &xys)
+{
+  QString xml = "<element type=\"boundary\"><vertices>";
+  foreach (QString xy, xys) {
+    xml += "<xy>" + xy + "</xy>";
+  }
+  xml += "</vertices></element>";
+  QXmlStreamReader reader(xml);
+  reader.readNextStartElement();
+  QScopedPointer<Element> elm(Element::fromXmlStream(reader));
+  return elm.isNull() ? QList<QPointF>() : elm->vertices();
+}
+
+static QString exact(double value)
+{
+  return QString::number(value, 'g', 17);
+}
+
+void TestLibrary::scan_coordinates()
+{
+  QStringList xys;
+  xys << "1 -2" << "+3.5 -0.25" << ".5 -.125" << "1.500000 2.000"
+      << "0 -0.0"
+      << "123456789012345 -0.123456789012345"
+      << "999999999999999 99999999999999.9"
+      << "1234567890123456 0.1234567890123456"
+      << "12345678901234567890 1"
+      << "1e-3 -2.5E2"
+      << "0.0000000000000000000000001 1"
+      << "  7\t8\n";
+  QList<QPointF> points = verticesFromXy(xys);
+  QCOMPARE(points.size(), xys.size());
+  for (int i = 0; i < xys.size(); i++) {
+    QStringList fields = xys.at(i).simplified().split(' ');
+    QCOMPARE(exact(points.at(i).x()), exact(fields.at(0).toDouble()));
+    QCOMPARE(exact(points.at(i).y()), exact(fields.at(1).toDouble()));
+  }
+
+  // Malformed xy texts are dropped, the others are kept in order.
+  QStringList bad;
+  bad << "1 2" << "3" << "4 5 6" << "abc 7" << "1.2.3 8" << "- 9"
+      << "10 11x" << "" << "12 13";
+  points = verticesFromXy(bad);
+  QCOMPARE(points.size(), 2);
+  QCOMPARE(points.at(0), QPointF(1, 2));
+  QCOMPARE(points.at(1), QPointF(12, 13));
+}
+
+void TestLibrary::layer_buckets()
+{
+  QList<Library*> libs = Library::availables();
+  QVERIFY(libs.size() > 0);
+  foreach (Library* lib, libs) {
+    lib->mount();
+    foreach (Structure *s, lib->structures()) {
+      const ElementStore &elements = s->elements();
+      int count = 0;
+      QMapIterator<LayerKey, QVector<int> > iter(s->layerBuckets());
+      while (iter.hasNext()) {
+        iter.next();
+        foreach (int index, iter.value()) {
+          ElementView view = elements.at(index);
+          QVERIFY(view.isPrimitive());
+          QCOMPARE(LayerKey(view.layerNumber(), view.datatype()), iter.key());
+          count++;
+        }
+      }
+      QCOMPARE(count, s->primitives().size());
+    }
+    lib->close();
+  }
+  Library::release(libs);
+}
+
+// Bounds of an element over all its placements, from the transforms
+// rather than the bounds the store keeps.
+static QRectF placedBounds(Library *lib, const ElementView &view)
+{
+  if (view.isPrimitive()) {
+    QRectF result;
+    Element::calcDataBounds(view.outlinePoints(), result);
+    return result;
+  }
+  Structure *child = lib->structureNamed(view.referenceName());
+  QRectF result;
+  if (child == nullptr) {
+    Element::resetToSmallBounds(result);
+    return result;
+  }
+  QRectF childBounds = child->dataBounds();
+  bool first = true;
+  foreach (const QMatrix &mat, view.transforms()) {
+    QRectF b = mat.mapRect(childBounds);
+    if (first) {
+      result = b;
+      first = false;
+    }
+    else {
+      result.setCoords(qMin(result.left(), b.left()), qMin(result.top(), b.top()),
+                       qMax(result.right(), b.right()), qMax(result.bottom(), b.bottom()));
+    }
+  }
+  return result;
+}
+
+void TestLibrary::spatial_index()
+{
+  QList<Library*> libs = Library::availables();
+  QVERIFY(libs.size() > 0);
+  foreach (Library* lib, libs) {
+    lib->mount();
+    foreach (Structure *s, lib->structures()) {
+      const ElementStore &elements = s->elements();
+      const SpatialIndex &index = s->spatialIndex();
+      QRectF bounds = s->dataBounds();
+      QRectF window(bounds.topLeft(), bounds.size() / 2);
+      QList<QRectF> windows;
+      windows << window << window.translated(bounds.width() / 2, bounds.height() / 2);
+      foreach (QRectF w, windows) {
+        QVector<int> expected;
+        for (int i = 0; i < elements.size(); i++) {
+          QRectF b = placedBounds(lib, elements.at(i));
+          if (b.left() <= w.right() && w.left() <= b.right()
+              && b.top() <= w.bottom() && w.top() <= b.bottom()) {
+            expected.append(i);
+          }
+        }
+        QCOMPARE(index.query(w), expected);
+        QPointF center = w.center();
+        foreach (int i, index.queryPoint(center)) {
+          QRectF b = placedBounds(lib, elements.at(i));
+          QVERIFY(b.left() <= center.x() && center.x() <= b.right()
+                  && b.top() <= center.y() && center.y() <= b.bottom());
+        }
+      }
+    }
+    lib->close();
+  }
+  Library::release(libs);
+}
+
+static int flattenedPrimitiveCount(Library *lib, Structure *s, int depth)
+{
+  if (depth > 64) {
+    return 0;
+  }
+  int count = s->primitives().size();
+  const ElementStore &elements = s->elements();
+  foreach (int index, s->srefs() + s->arefs()) {
+    ElementView view = elements.at(index);
+    Structure *child = lib->structureNamed(view.referenceName());
+    if (child != nullptr) {
+      int placements = view.rowCount() * view.columnCount();
+      count += placements * flattenedPrimitiveCount(lib, child, depth + 1);
+    }
+  }
+  return count;
+}
+
+static QString hitKey(Structure *s, int index, const QMatrix &m)
+{
+  return QString("%1/%2 %3 %4 %5 %6 %7 %8").arg(s->name()).arg(index)
+      .arg(m.m11(), 0, 'g', 17).arg(m.m12(), 0, 'g', 17)
+      .arg(m.m21(), 0, 'g', 17).arg(m.m22(), 0, 'g', 17)
+      .arg(m.dx(), 0, 'g', 17).arg(m.dy(), 0, 'g', 17);
+}
+
+static bool isOrthogonal(const QMatrix &m)
+{
+  return (qFuzzyIsNull(m.m12()) && qFuzzyIsNull(m.m21()))
+      || (qFuzzyIsNull(m.m11()) && qFuzzyIsNull(m.m22()));
+}
+
+// Every placed primitive of s whose bounds, mapped to the top, overlap
+// window. orthogonal is cleared when a placement rotates by other than a
+// multiple of 90 degrees, where mapped bounds are no longer exact.
+static void flattenWindow(Library *lib, Structure *s, const QMatrix &toTop, int depth,
+                          const QRectF &window, QStringList &keys, bool &orthogonal)
+{
+  if (depth > 64) {
+    return;
+  }
+  orthogonal = orthogonal && isOrthogonal(toTop);
+  const ElementStore &elements = s->elements();
+  for (int i = 0; i < elements.size(); i++) {
+    ElementView view = elements.at(i);
+    if (view.isPrimitive()) {
+      QRectF b = toTop.mapRect(view.dataBounds());
+      if (b.left() <= window.right() && window.left() <= b.right()
+          && b.top() <= window.bottom() && window.top() <= b.bottom()) {
+        keys.append(hitKey(s, i, toTop));
+      }
+      continue;
+    }
+    Structure *child = lib->structureNamed(view.referenceName());
+    if (child == nullptr) {
+      continue;
+    }
+    foreach (const QMatrix &mat, view.transforms()) {
+      flattenWindow(lib, child, mat * toTop, depth + 1, window, keys, orthogonal);
+    }
+  }
+}
+
+void TestLibrary::region_query()
+{
+  QList<Library*> libs = Library::availables();
+  QVERIFY(libs.size() > 0);
+  foreach (Library* lib, libs) {
+    lib->mount();
+    Hierarchy hierarchy(lib);
+    foreach (QString name, hierarchy.topStructures()) {
+      Structure *top = lib->structureNamed(name);
+      RegionQuery everything(top);
+      QList<RegionHit> hits = everything.run(top->dataBounds().adjusted(-1, -1, 1, 1));
+      QCOMPARE(hits.size(), flattenedPrimitiveCount(lib, top, 0));
+
+      // An offset window and one zoomed into the middle of the first
+      // array, with odd fractions so no edge meets element bounds.
+      QRectF b = top->dataBounds();
+      QList<QRectF> windows;
+      windows << QRectF(b.left() + b.width() * 0.3137, b.top() + b.height() * 0.2719,
+                        b.width() * 0.2311, b.height() * 0.4173);
+      if (! top->arefs().isEmpty()) {
+        QRectF r = placedBounds(lib, top->elements().at(top->arefs().first()));
+        windows << QRectF(r.left() + r.width() / 3.07, r.top() + r.height() / 2.93,
+                          r.width() / 3.11, r.height() / 3.03);
+      }
+      foreach (QRectF w, windows) {
+        RegionQuery zoomed(top);
+        QStringList found;
+        foreach (const RegionHit &hit, zoomed.run(w)) {
+          found.append(hitKey(hit.structure, hit.index, hit.transform));
+        }
+        QVERIFY(zoomed.visitedPlacements() <= everything.visitedPlacements());
+        QStringList expected;
+        bool orthogonal = true;
+        flattenWindow(lib, top, QMatrix(), 0, w, expected, orthogonal);
+        found.sort();
+        expected.sort();
+        if (orthogonal) {
+          QCOMPARE(found, expected);
+        }
+        else {
+          // Rotated windows are carried down as their bounding boxes, so
+          // the query may also return elements just outside.
+          foreach (QString key, expected) {
+            QVERIFY(found.contains(key));
+          }
+        }
+      }
+    }
+    lib->close();
+  }
+  Library::release(libs);
+}
+
+static ElementRecord newRecord(int kind, quint32 vertexCount)
+{
+  ElementRecord record;
+  memset(&record, 0, sizeof(record));
+  record.kind = kind;
+  record.vertexCount = vertexCount;
+  return record;
+}
+
+// A structure directory without any generation file reads as an empty
+// structure instead of looking up a file that is not there.
+void TestLibrary::empty_structure()
+{
+  QTemporaryDir tmp;
+  QVERIFY(tmp.isValid());
+  QDir dir(tmp.path());
+  QVERIFY(dir.mkdir("EMPTY.structure"));
+
+  Structure s(QFileInfo(dir.absoluteFilePath("EMPTY.structure")));
+  QCOMPARE(s.generation(), -1);
+  QCOMPARE(s.parseHeader().elementCount, 0);
+  QCOMPARE(s.header().elementCount, 0);
+  QVERIFY(s.header().references.isEmpty());
+  QCOMPARE(s.elements().size(), 0);
+  QVERIFY(s.isLoaded());
+  QVERIFY(! s.isDirty());
+}
+
+// Writes one element of each kind through Structure::store() into a
+// standalone structure directory and checks they read back the same.
+void TestLibrary::store_round_trip()
+{
+  QTemporaryDir tmp;
+  QVERIFY(tmp.isValid());
+  QDir dir(tmp.path());
+  QVERIFY(dir.mkdir("RT.structure"));
+  dir.cd("RT.structure");
+
+  QList<ElementRecord> records;
+  QStringList names;
+  QList<QVector<double> > coordinates;
+
+  ElementRecord boundary = newRecord(Element::BoundaryKind, 5);
+  boundary.layerNumber = 3;
+  boundary.datatype = 1;
+  records << boundary;
+  names << QString();
+  coordinates << (QVector<double>() << 0 << 0 << 10 << 0 << 10 << 5.5 << 0 << 5.5 << 0 << 0);
+
+  ElementRecord path = newRecord(Element::PathKind, 3);
+  path.layerNumber = 7;
+  path.datatype = 2;
+  path.pathtype = 2;
+  path.width = 2.5;
+  records << path;
+  names << QString();
+  coordinates << (QVector<double>() << -1 << -1 << 20 << -1 << 20 << 30.25);
+
+  ElementRecord sref = newRecord(Element::SrefKind, 1);
+  sref.mag = 2;
+  sref.angle = 90;
+  sref.reflected = 1;
+  records << sref;
+  names << "CHILD";
+  coordinates << (QVector<double>() << 100 << 200);
+
+  ElementRecord aref = newRecord(Element::ArefKind, 1);
+  aref.mag = 1;
+  aref.angle = 180;
+  aref.rowCount = 3;
+  aref.columnCount = 4;
+  aref.rowStep = 12.5;
+  aref.columnStep = -7.75;
+  records << aref;
+  names << "CHILD";
+  coordinates << (QVector<double>() << -50 << 25);
+
+  Structure s(QFileInfo(dir.absolutePath()));
+  QCOMPARE(s.generation(), -1);
+  for (int i = 0; i < records.size(); i++) {
+    QScopedPointer<Element> elm(Element::fromRecord(records.at(i), names.at(i),
+                                                    coordinates.at(i).constData()));
+    QVERIFY(! elm.isNull());
+    s.addElement(elm.data());
+  }
+  QVERIFY(s.isDirty());
+  s.store();
+  QVERIFY(! s.isDirty());
+  QCOMPARE(s.generation(), 1);
+  QVERIFY(dir.exists("RT.1.gdsfeelbeta"));
+  QVERIFY(s.unload());
+
+  const ElementStore &elements = s.elements();
+  QCOMPARE(elements.size(), records.size());
+  for (int i = 0; i < records.size(); i++) {
+    ElementRecord expected = records.at(i);
+    QString name;
+    ElementRecord actual = elements.recordAt(i, name);
+    QCOMPARE((int) actual.kind, (int) expected.kind);
+    QCOMPARE(actual.layerNumber, expected.layerNumber);
+    QCOMPARE(actual.datatype, expected.datatype);
+    QCOMPARE(actual.pathtype, expected.pathtype);
+    QCOMPARE(actual.width, expected.width);
+    QCOMPARE(actual.mag, expected.mag);
+    QCOMPARE(actual.angle, expected.angle);
+    QCOMPARE((int) actual.reflected, (int) expected.reflected);
+    QCOMPARE(actual.rowCount, expected.rowCount);
+    QCOMPARE(actual.columnCount, expected.columnCount);
+    QCOMPARE(actual.rowStep, expected.rowStep);
+    QCOMPARE(actual.columnStep, expected.columnStep);
+    QCOMPARE(name, names.at(i));
+    QCOMPARE(actual.vertexCount, expected.vertexCount);
+    for (quint32 v = 0; v < expected.vertexCount; v++) {
+      QPointF pt = elements.at(i).vertex(v);
+      QCOMPARE(pt.x(), coordinates.at(i).at(2 * v));
+      QCOMPARE(pt.y(), coordinates.at(i).at(2 * v + 1));
+    }
+  }
+}
+
+// Adding an element far outside a referenced structure grows the
+// bounds of every structure above it, and their spatial indexes follow.
+void TestLibrary::edit_resets_parents()
+{
+  QList<Library*> libs = Library::availables();
+  QVERIFY(libs.size() > 0);
+  foreach (Library* lib, libs) {
+    lib->mount();
+    Hierarchy hierarchy(lib);
+    foreach (QString name, hierarchy.topologicalOrder()) {
+      QStringList parents = hierarchy.parents(name);
+      if (parents.isEmpty()) continue;
+      Structure *child = lib->structureNamed(name);
+      Structure *parent = lib->structureNamed(parents.first());
+      QStringList grandparents = hierarchy.parents(parent->name());
+      Structure *top = grandparents.isEmpty() ? 0 : lib->structureNamed(grandparents.first());
+      QRectF parentBefore = parent->dataBounds();
+      QRectF topBefore = top ? top->dataBounds() : QRectF();
+      parent->spatialIndex();
+
+      ElementRecord record = newRecord(Element::BoundaryKind, 5);
+      record.layerNumber = 1;
+      double far = 1e9;
+      double coords[] = { far, far, far + 1, far, far + 1, far + 1, far, far + 1, far, far };
+      QScopedPointer<Element> boundary(Element::fromRecord(record, QString(), coords));
+      QVERIFY(! boundary.isNull());
+      child->addElement(boundary.data());
+
+      QVERIFY(parent->dataBounds() != parentBefore);
+      QVERIFY(parent->dataBounds().contains(parentBefore));
+      QCOMPARE(parent->summary().bounds, parent->dataBounds());
+      if (top != nullptr) {
+        QVERIFY(top->dataBounds() != topBefore);
+      }
+      const ElementStore &elements = parent->elements();
+      int placement = -1;
+      for (int i = 0; i < elements.size() && placement < 0; i++) {
+        if (elements.at(i).isReference() && elements.at(i).referenceName() == name) {
+          placement = i;
+        }
+      }
+      QVERIFY(placement >= 0);
+      QPointF p = elements.at(placement).transform().map(QPointF(far + 0.5, far + 0.5));
+      QVector<int> hits = parent->spatialIndex().query(QRectF(p.x() - 1, p.y() - 1, 2, 2));
+      QVERIFY(hits.contains(placement));
+      break;
+    }
+    lib->close();
+  }
+  Library::release(libs);
+}
+
+// Saving after one edit adds the new generation and copies every
+// other member with its crc and compressed size unchanged.
+void TestLibrary::save_copies_untouched()
+{
+  QFileInfoList infos = Library::files();
+  QVERIFY(infos.size() > 0);
+  QTemporaryDir tmp;
+  QVERIFY(tmp.isValid());
+  QString path = QDir(tmp.path()).absoluteFilePath(infos.first().fileName());
+  QVERIFY(QFile::copy(infos.first().absoluteFilePath(), path));
+
+  QHash<QString, QZipReader::FileInfo> before;
+  {
+    QZipReader reader(path);
+    foreach (QZipReader::FileInfo entry, reader.fileInfoList()) {
+      before.insert(entry.filePath, entry);
+    }
+  }
+
+  Library lib(path);
+  lib.open();
+  QVERIFY(lib.structures().size() > 0);
+  Structure *s = lib.structures().first();
+  QString added = QString("/%1.%2.gdsfeelbeta").arg(s->name()).arg(s->generation() + 1);
+  ElementRecord record = newRecord(Element::BoundaryKind, 5);
+  record.layerNumber = 1;
+  double coords[] = { 0, 0, 1, 0, 1, 1, 0, 1, 0, 0 };
+  QScopedPointer<Element> boundary(Element::fromRecord(record, QString(), coords));
+  QVERIFY(! boundary.isNull());
+  s->addElement(boundary.data());
+  lib.close();
+  QVERIFY(lib.isClose());
+
+  QZipReader reader(path);
+  bool found = false;
+  foreach (QZipReader::FileInfo entry, reader.fileInfoList()) {
+    if (entry.filePath.endsWith(added)) {
+      found = true;
+    }
+    if (! before.contains(entry.filePath) || entry.filePath == "LIB.ini") continue;
+    QZipReader::FileInfo old = before.value(entry.filePath);
+    QCOMPARE(entry.crc32, old.crc32);
+    QCOMPARE(entry.compressedSize, old.compressedSize);
+  }
+  QVERIFY(found);
+}
+
+void TestLibrary::cache_cleanup()
+{
+  QDir dir(QDir(Config::pathToCache()).absoluteFilePath("CLEANUPTEST"));
+  QVERIFY(dir.mkpath("."));
+  QStringList names;
+  names << "A.1.cache" << "A.B.3.cache" << "AB.1.cache";
+  foreach (QString name, names) {
+    QFile file(dir.absoluteFilePath(name));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+  }
+  StructureCache cache("CLEANUPTEST");
+  cache.store("A", 2, CacheKey(), ElementStore());
+  QVERIFY(! dir.exists("A.1.cache"));
+  QVERIFY(dir.exists("A.2.cache"));
+  QVERIFY(dir.exists("A.B.3.cache"));
+  QVERIFY(dir.exists("AB.1.cache"));
+  dir.removeRecursively();
+}
+
+// An image written from an extracted file matches by its size and time
+// without a crc, and by the crc alone once the file has been read.
+void TestLibrary::cache_keys()
+{
+  QDir dir(QDir(Config::pathToCache()).absoluteFilePath("KEYTEST"));
+  StructureCache cache("KEYTEST");
+  CacheKey written;
+  written.hasCrc = true;
+  written.crc = 0x1234;
+  written.size = 100;
+  written.modified = 5000;
+  ElementStore store;
+  cache.store("A", 1, written, store);
+
+  CacheKey stamp;
+  stamp.size = 100;
+  stamp.modified = 5000;
+  QVERIFY(cache.loadStore("A", 1, stamp, store));
+  stamp.modified = 5001;
+  QVERIFY(! cache.loadStore("A", 1, stamp, store));
+  CacheKey content;
+  content.hasCrc = true;
+  content.crc = 0x1234;
+  QVERIFY(cache.loadStore("A", 1, content, store));
+  content.crc = 0x1235;
+  QVERIFY(! cache.loadStore("A", 1, content, store));
+
+  CacheKey archived;
+  archived.hasCrc = true;
+  archived.crc = 0x1234;
+  cache.store("A", 2, archived, store);
+  QVERIFY(! cache.loadStore("A", 2, CacheKey(), store));
+  dir.removeRecursively();
+}
+
+// data/zip64.zip keeps its sizes and offsets only in Zip64 extra
+// fields: a.txt (stored) has all three, b.txt (deflated) only the
+// offset. The end of directory points to a Zip64 record.
+// Accepts writes up to a limit, then writes short.
+class ShortBuffer : public QBuffer
+{
+public:
+  ShortBuffer(qint64 limit) : _limit(limit) {}
+
+protected:
+  qint64 writeData(const char *data, qint64 len)
+  {
+    qint64 room = qMax(Q_INT64_C(0), _limit - pos());
+    return QBuffer::writeData(data, qMin(len, room));
+  }
+
+private:
+  qint64 _limit;
+};
+
+static QZipWriter::Status writeSample(QIODevice *device, int workers)
+{
+  QZipWriter writer(device);
+  writer.setWorkerCount(workers);
+  writer.addDirectory("dir");
+  for (int i = 0; i < 40; i++) {
+    QByteArray data = QByteArray::number(i);
+    if (i % 3 != 0) {
+      data = QByteArray("deflated entry ").append(data).repeated(20 + i);
+    }
+    writer.addFile(QString("dir/f%1").arg(i), data);
+  }
+  writer.close();
+  return writer.status();
+}
+
+static QByteArray sampleZip(int workers)
+{
+  QBuffer buffer;
+  writeSample(&buffer, workers);
+  return buffer.data();
+}
+
+// The archive does not depend on how many workers compress it. Entries
+// carry the time they were added, so retry when a pass straddles a
+// change of the two second DOS timestamp.
+void TestLibrary::zip_workers()
+{
+  QByteArray serial;
+  QByteArray parallel;
+  for (int attempt = 0; attempt < 3; attempt++) {
+    serial = sampleZip(1);
+    parallel = sampleZip(4);
+    if (sampleZip(1) == serial) break;
+  }
+  QCOMPARE(parallel, serial);
+
+  QBuffer buffer(&serial);
+  QZipReader reader(&buffer);
+  QCOMPARE(reader.count(), 41);
+  QZipReader::FileInfo deflated = reader.entryInfo("dir/f1");
+  QVERIFY(deflated.compressedSize < deflated.size);
+  QCOMPARE(reader.fileData("dir/f1"), QByteArray("deflated entry 1").repeated(21));
+  QCOMPARE(reader.fileData("dir/f39"), QByteArray("39"));
+  reader.close();
+
+  ShortBuffer shortSerial(serial.size() / 2);
+  QCOMPARE(writeSample(&shortSerial, 1), QZipWriter::FileWriteError);
+  ShortBuffer shortParallel(serial.size() / 2);
+  QCOMPARE(writeSample(&shortParallel, 4), QZipWriter::FileWriteError);
+}
+
+void TestLibrary::zip64_fixture()
+{
+  QString path = QFINDTESTDATA("data/zip64.zip");
+  QVERIFY(! path.isEmpty());
+  QZipReader reader(path);
+  QCOMPARE(reader.count(), 2);
+  QZipReader::FileInfo a = reader.entryInfo("a.txt");
+  QCOMPARE(a.size, (qint64) 12);
+  QCOMPARE(reader.fileData("a.txt"), QByteArray("hello zip64\n"));
+  QZipReader::FileInfo b = reader.entryInfo("b.txt");
+  QCOMPARE(b.size, (qint64) 460);
+  QCOMPARE(reader.fileData("b.txt"), QByteArray("second entry, deflated ").repeated(20));
+  reader.close();
+}
+
+void TestLibrary::zip64_round_trip()
+{
+  const int count = 0x10000 + 1;
+  QBuffer buffer;
+  {
+    QZipWriter writer(&buffer);
+    writer.setCompressionPolicy(QZipWriter::NeverCompress);
+    for (int i = 0; i < count; i++) {
+      writer.addFile(QString("f%1").arg(i), QByteArray::number(i));
+    }
+    writer.close();
+    QCOMPARE(writer.status(), QZipWriter::NoError);
+  }
+  QVERIFY(buffer.data().contains(QByteArray("PK\x06\x06", 4)));
+  QVERIFY(buffer.data().contains(QByteArray("PK\x06\x07", 4)));
+  QZipReader reader(&buffer);
+  QCOMPARE(reader.count(), count);
+  QCOMPARE(reader.fileData("f0"), QByteArray("0"));
+  QCOMPARE(reader.fileData(QString("f%1").arg(count - 1)), QByteArray::number(count - 1));
+  reader.close();
+}
+
 QTEST_APPLESS_MAIN(TestLibrary)
 #include "testlibrary.moc"
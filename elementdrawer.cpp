@@ -1,137 +1,142 @@
-#include "elementdrawer.h"
-
-#include "GdsFeelCore/element.h"
-#include "GdsFeelCore/structure.h"
-#include "GdsFeelCore/library.h"
-
-namespace Gds {
-
-ElementDrawer::ElementDrawer(Element *elm, Station *station)
-{
-  _element = elm;
-  _station = station;
-}
-
-
-static void pointsToPath(QList<QPointF> points, QPainterPath &path)
-{
-  int i = 0;
-  foreach(QPointF p , points) {
-    if (i == 0) {
-      path.moveTo(p);
-    }
-    else {
-      path.lineTo(p);
-    }
-    i++;
-  }
-}
-
-
-static void setElementPath(Element *elm, QPainterPath &path)
-{
-  pointsToPath(elm->outlinePoints(), path);
-}
-
-
-QColor ElementDrawer::colorForElement(Element * ge)
-{
-  if (PrimitiveElement *pe = qobject_cast<PrimitiveElement *>(ge)) {
-    return _station->library()->colorForLayerNumber(pe->layerNumber());
-  }
-  return Qt::darkGray;
-}
-
-
-void ElementDrawer::setupPen(QPen &pen)
-{
-  pen.setColor(colorForElement(_element));
-  pen.setWidthF(0.0f);
-}
-
-
-void ElementDrawer::installGraphicsItemOn(QGraphicsScene *scene)
-{
-  QPainterPath path;
-  QPen pen;
-  setElementPath(_element, path);
-  setupPen(pen);
-  scene->addPath(path, pen);
-}
-
-
-static bool LayerLessThan(Element* e1, Element* e2)
-{
-  PrimitiveElement *pe1 = qobject_cast<PrimitiveElement *>(e1);
-  PrimitiveElement *pe2 = qobject_cast<PrimitiveElement *>(e2);
-  return pe1->layerNumber() < pe2->layerNumber();
-}
-
-
-void ElementDrawer::layerOrderedElements(
-    Structure *structure,
-    QList<Element*> &primitives,
-    QList<Element*> &refereces)
-{
-  foreach (Element *elm, structure->elements()) {
-    if (PrimitiveElement *pe = qobject_cast<PrimitiveElement *>(elm)) {
-      primitives.append(pe);
-    }
-    else {
-      refereces.append(elm);
-    }
-  }
-  qSort(primitives.begin(), primitives.end(), LayerLessThan);
-}
-
-void ElementDrawer::installStructure(
-    Structure *structure,
-    QGraphicsScene *scene,
-    Station *station)
-{
-
-}
-
-
-ElementDrawer* ElementDrawer::fromElement(Element *elm, Station *station)
-{
-  QString type = QString(elm->metaObject()->className());
-  if (type == QString("Gds::Aref")) {
-    return new ArefDrawer(elm, station);
-  }
-  return new ElementDrawer(elm, station);
-}
-
-SrefDrawer::SrefDrawer(Element *elm, Station *station)
-  : ElementDrawer(elm, station)
-{
-}
-
-void SrefDrawer::installGraphicsItemOn(QGraphicsScene * __attribute__((unused)) scene)
-{
-}
-
-ArefDrawer::ArefDrawer(Element *elm, Station *station)
-  : ElementDrawer(elm, station)
-{
-}
-
-
-void ArefDrawer::installGraphicsItemOn(QGraphicsScene *scene)
-{
-  QPainterPath path;
-  QPen pen;
-
-  foreach (QMatrix mat, arefElement()->transforms()) {
-    QList<QPointF> points;
-    arefElement()->lookupOutlinePoints(mat, points);
-    pointsToPath(points, path);
-    points.clear();
-  }
-
-  setupPen(pen);
-  scene->addPath(path, pen);
-}
-
-
-} // namespace Gds
+#include "elementdrawer.h"
+
+#include "GdsFeelCore/element.h"
+#include "GdsFeelCore/structure.h"
+#include "GdsFeelCore/library.h"
+
+namespace Gds {
+
+ElementDrawer::ElementDrawer(const ElementView &view, Station *station)
+  : _view(view)
+{
+  _station = station;
+}
+
+
+static void pointsToPath(QList<QPointF> points, QPainterPath &path)
+{
+  int i = 0;
+  foreach(QPointF p , points) {
+    if (i == 0) {
+      path.moveTo(p);
+    }
+    else {
+      path.lineTo(p);
+    }
+    i++;
+  }
+}
+
+
+QColor ElementDrawer::colorForElement()
+{
+  if (_view.isPrimitive()) {
+    return _station->library()->colorForLayerNumber(_view.layerNumber());
+  }
+  return Qt::darkGray;
+}
+
+
+void ElementDrawer::setupPen(QPen &pen)
+{
+  pen.setColor(colorForElement());
+  pen.setWidthF(0.0f);
+}
+
+
+// Outline of the referenced structure's bounds placed by mat, as
+// Sref::lookupOutlinePoints() gives it.
+void ElementDrawer::addReferenceOutline(const QMatrix &mat, QPainterPath &path)
+{
+  Structure *ref = _station->library()->structureNamed(_view.referenceName());
+  if (ref == nullptr) {
+    qDebug() << "structure not found: " << _view.referenceName() << endl;
+    return;
+  }
+  QList<QPointF> outlinePoints;
+  Element::calcOutlinePoints(ref->dataBounds(), outlinePoints);
+  QList<QPointF> points;
+  foreach (QPointF p, outlinePoints) {
+    points.append(mat.map(p));
+  }
+  pointsToPath(points, path);
+}
+
+
+void ElementDrawer::installGraphicsItemOn(QGraphicsScene *scene)
+{
+  QPainterPath path;
+  QPen pen;
+  pointsToPath(_view.outlinePoints(), path);
+  setupPen(pen);
+  scene->addPath(path, pen);
+}
+
+
+void ElementDrawer::layerOrderedElements(
+    Structure *structure,
+    QVector<int> &primitives,
+    QVector<int> &refereces)
+{
+  foreach (const QVector<int> &bucket, structure->layerBuckets()) {
+    primitives += bucket;
+  }
+  refereces += structure->srefs();
+  refereces += structure->arefs();
+}
+
+void ElementDrawer::installStructure(
+    Structure *structure,
+    QGraphicsScene *scene,
+    Station *station)
+{
+
+}
+
+
+ElementDrawer* ElementDrawer::fromView(const ElementView &view, Station *station)
+{
+  if (view.kind() == Element::ArefKind) {
+    return new ArefDrawer(view, station);
+  }
+  if (view.kind() == Element::SrefKind) {
+    return new SrefDrawer(view, station);
+  }
+  return new ElementDrawer(view, station);
+}
+
+SrefDrawer::SrefDrawer(const ElementView &view, Station *station)
+  : ElementDrawer(view, station)
+{
+}
+
+void SrefDrawer::installGraphicsItemOn(QGraphicsScene *scene)
+{
+  QPainterPath path;
+  QPen pen;
+  addReferenceOutline(_view.transform(), path);
+  setupPen(pen);
+  scene->addPath(path, pen);
+}
+
+ArefDrawer::ArefDrawer(const ElementView &view, Station *station)
+  : ElementDrawer(view, station)
+{
+}
+
+
+void ArefDrawer::installGraphicsItemOn(QGraphicsScene *scene)
+{
+  QPainterPath path;
+  QPen pen;
+
+  foreach (QMatrix mat, _view.transforms()) {
+    addReferenceOutline(mat, path);
+  }
+
+  setupPen(pen);
+  scene->addPath(path, pen);
+}
+
+
+} // namespace Gds